@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "agon_vdp.h"
+#include "emu-library/schedule.h"
 #include "agon_font.h"					// fotn data from VDP src
 #include "agon_palette.h"
 #include "debug/debug.h"
@@ -38,8 +39,14 @@
 static uint8_t vdp_serial_output_buffer[VDP_SERIAL_OUTPUT_BUFFER_SIZE];        // VDP output serial buffer
 static uint8_t vdp_serial_output_queue_len;																		// Current serial buffer status/length
 
-static uint8_t vdp_serial_input_buffer[VDP_SERIAL_OUTPUT_BUFFER_SIZE];        // VDP intput serial buffer
-static uint8_t vdp_serial_input_queue_len;																		// Current input serial buffer length
+#define VDP_LINK_BUFFER_SIZE 4096
+#define VDP_LINE_RATE        31469	// 640x480 VGA scanlines per second
+
+static uint8_t vdp_link_buffer[VDP_LINK_BUFFER_SIZE];										// Bytes from the eZ80 UART, parsed in batches
+static uint8_t *vdp_serial_input = vdp_link_buffer;											// First byte of the next VDU command
+static uint16_t vdp_serial_input_queue_len;																		// Bytes from there still to parse
+static uint32_t vdp_link_cycles;																						// CPU cycles between batches, 0 for one scanline
+static uint64_t vdp_link_last;																							// Cycle of the last batch
 
 #define TEXT_COLUMNS    80
 #define TEXT_ROWS       24
@@ -72,6 +79,7 @@ static SDL_Renderer *sdlRenderer = NULL;
 
 // Forward declarations
 void handle_VDU_command();
+static void vdp_link_drain();
 void drawChar(uint8_t c);
 void drawString(char *s);
 
@@ -265,6 +273,7 @@ int vdp_init() {
   drawChar('\n');
 
   vdp_serial_output_queue_len = 0;
+  vdp_serial_input = vdp_link_buffer;
   vdp_serial_input_queue_len = 0;
 
   //memset(vdp_output_buffer, blah blah blah);
@@ -288,13 +297,11 @@ void vdp_shutdown()
 		}
 }
 
-/// Read from VDP status (port 0xC5 (197))
-/// @return         VDP status
+/// VDP side of the serial link, polled by the UART0 model
+/// @return         UART_LSR_DATA_READY while bytes are queued for the CPU
 uint8_t vdp_read_status_byte()
 {
-  // TODO - Check this and correct!
-  // Should return 1 if data available, 0 if no data pending
-  uint8_t status = UART_LSR_TEMT;                     // Set incoming transmit empty, so CPU will send data
+  uint8_t status = UART_LSR_TEMT;                     // The VDP always accepts data
   if (vdp_serial_output_queue_len > 0)
       status |= UART_LSR_DATA_READY;
     
@@ -314,22 +321,27 @@ uint8_t vdp_read_serial()
 }
 
 /// Write to VDP serial port (UART) - ie Write from CPU!
+/// Bytes are only buffered here, vdp_tick() parses them in batches
 /// @param[in] c         Byte to send to VDP
 void vdp_write_serial(uint8_t c)
 {
-    printf("vdp_write_serial: %d\n", c);
-		vdp_serial_input_buffer[vdp_serial_input_queue_len] = c;
-		vdp_serial_input_queue_len++;
-
-		// NOw handled in vdu_tick()
-    //handle_VDU_command(c);
+	if (vdp_serial_input + vdp_serial_input_queue_len == vdp_link_buffer + VDP_LINK_BUFFER_SIZE)
+		{
+		// Make room by parsing what we have now
+		vdp_link_drain();
+		if (vdp_serial_input_queue_len == VDP_LINK_BUFFER_SIZE)
+			{
+			printf("vdp_write_serial: Link buffer full!\n");
+			return;
+			}
+		}
+	vdp_serial_input[vdp_serial_input_queue_len++] = c;
 }
 
 /// Remove n bytes from the serial input queue (ie: when they have been processed)
 /// @param[in] count				Number of bytes to unqueue
 void vdp_unqueue_input(uint8_t count)
 {
-	// shift input queue
 	if (count > vdp_serial_input_queue_len)
 		{
 		printf("Error: vdp_unqueue_input - underflow!\n");
@@ -337,14 +349,35 @@ void vdp_unqueue_input(uint8_t count)
 		return;
 		}
 
-	int i = 0;
-	for (i = 0; i < (vdp_serial_input_queue_len - count); i++)
-			vdp_serial_input_buffer[i] = vdp_serial_input_buffer[i + count];
-
-	vdp_serial_input_buffer[i] = 0;			// put null marker in there fro debugging
+	vdp_serial_input += count;
 	vdp_serial_input_queue_len -= count;
 }
 
+/// Parse every complete VDU command in the link buffer
+static void vdp_link_drain()
+{
+	uint16_t len;
+
+	// Stop at a command still waiting for its parameters
+	do
+		{
+		len = vdp_serial_input_queue_len;
+		handle_VDU_command();
+		}
+	while (vdp_serial_input_queue_len > 0 && vdp_serial_input_queue_len != len);
+
+	// Move what's left to the front for the next batch
+	memmove(vdp_link_buffer, vdp_serial_input, vdp_serial_input_queue_len);
+	vdp_serial_input = vdp_link_buffer;
+}
+
+/// Set how often vdp_tick() parses the bytes sent by the eZ80
+/// @param[in] cycles			CPU cycles between batches, 0 for once per scanline
+void vdp_set_link_cadence(uint32_t cycles)
+{
+	vdp_link_cycles = cycles;
+}
+
 // Redraw the text screen buffer to the emulators console
 void drawTextScreen()
 {
@@ -427,7 +460,7 @@ void vdu_sys_sprites();
 /// Handle VDU 23 commands
 void vdu_sys()
 {
-	uint8_t mode = vdp_serial_input_buffer[1];
+	uint8_t mode = vdp_serial_input[1];
 //	debug_log("vdu_sys: %d\n\r", mode);
 	//
 	// If mode < 32, then it's a system command
@@ -446,7 +479,7 @@ void vdu_sys()
 			case 0x01:						// VDU 23, 1
 				if (vdp_serial_input_queue_len >= 3)
 					{
-					VDP_State.cursorEnabled = vdp_serial_input_buffer[2];	// Cursor control
+					VDP_State.cursorEnabled = vdp_serial_input[2];	// Cursor control
 					vdp_unqueue_input(3);
 					}
 				break;
@@ -477,7 +510,7 @@ void vdu_sys()
 			uint8_t *ptr = &FONT_AGON_DATA[mode * 8];
 			for(int i = 0; i < 8; i++)
 				{
-				*ptr++ = vdp_serial_input_buffer[i + 2];
+				*ptr++ = vdp_serial_input[i + 2];
 				}
 			vdp_unqueue_input(10);
 			}
@@ -488,12 +521,12 @@ void vdu_sys()
 // These can send responses back; the response contains a packet # that matches the VDU command mode byte
 //
 void vdu_sys_video() {
-		uint8_t mode = vdp_serial_input_buffer[2];
+		uint8_t mode = vdp_serial_input[2];
   	switch(mode) {
 		case PACKET_KEYCODE: 		// VDU 23, 0, 1, layout
 			if (vdp_serial_input_queue_len >= 4)
 				{
-				uint8_t layout =  vdp_serial_input_buffer[2];
+				uint8_t layout =  vdp_serial_input[2];
 				switch(layout) {
 					case 1:				// US Layout
 						//PS2Controller.keyboard()->setLayout(&fabgl::USLayout);
@@ -572,8 +605,8 @@ void vdu_sys_video() {
 /// Handle VDU 29
 void vdu_origin()
 {
-	VDP_State.originX = vdp_serial_input_buffer[1] * 256 * vdp_serial_input_buffer[2];
-	VDP_State.originY = vdp_serial_input_buffer[3] * 256 * vdp_serial_input_buffer[4];
+	VDP_State.originX = vdp_serial_input[1] * 256 * vdp_serial_input[2];
+	VDP_State.originY = vdp_serial_input[3] * 256 * vdp_serial_input[4];
 	//debug_log("vdu_origin: %d,%d\n\r", origin.X, origin.Y);
 }
 
@@ -628,7 +661,7 @@ void drawString(char *s)
 
 void vdu_colour()
 {
-	uint8_t index = vdp_serial_input_buffer[1];
+	uint8_t index = vdp_serial_input[1];
 	if(index >= 0 && index < 64)
 		{
 		RGB888 c = colourLookup[index];
@@ -656,7 +689,7 @@ void handle_VDU_command()
 		return;
 
 	// Handle single-char putc
-	uint8_t c = vdp_serial_input_buffer[0];
+	uint8_t c = vdp_serial_input[0];
 	if(c >= 0x20 && c != 0x7F)
 		{
 		//Canvas->setPenColor(tfg);
@@ -710,7 +743,7 @@ void handle_VDU_command()
 		case 0x16:  // Mode
 			if (vdp_serial_input_queue_len > 1)
 				{
-				vdu_mode(vdp_serial_input_buffer[1]);
+				vdu_mode(vdp_serial_input[1]);
 				vdp_unqueue_input(2);
 				}
 			break;
@@ -737,7 +770,7 @@ void handle_VDU_command()
 		case 0x1F:	// TAB(X,Y)  - JH - NOT REALLY A TAB, MORE LIKE A SETPOS
 			if (vdp_serial_input_queue_len > 2)
 				{
-				cursorTab(vdp_serial_input_buffer[1], vdp_serial_input_buffer[2]);
+				cursorTab(vdp_serial_input[1], vdp_serial_input[2]);
 				vdp_unqueue_input(3);
 				}
 			break;
@@ -761,12 +794,14 @@ void vdp_tick()
 
 	// - Read keyboard
 
-	// - Read serial command stream
+	// - Read serial command stream, a batch at a time
+	uint64_t now = sched_total_cycles();
+	uint32_t cadence = vdp_link_cycles ? vdp_link_cycles : sched_get_clock_rate(CLOCK_CPU) / VDP_LINE_RATE;
+	if (now - vdp_link_last < cadence)
+		return;
+	vdp_link_last = now;
 	if (vdp_serial_input_queue_len > 0)
-		{
-		// See if we can process the VDU command
-		handle_VDU_command();
-		}
+		vdp_link_drain();
 
 }
 
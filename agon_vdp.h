@@ -12,18 +12,21 @@ extern "C" {
 /// Initilaise VDP ("boot" VDP)
 extern int vdp_init();
 
-/// Read from VDP status (port 0xC5 (197))
+/// VDP side of the serial link, bit 0 is set while bytes are queued for the CPU (polled by the UART0 model)
 extern uint8_t vdp_read_status_byte();
 
-/// Read from VDP serial port (UART) (port 0xC0 (192))
+/// Take the next byte queued for the CPU, called by UART0 as it receives it
 extern uint8_t vdp_read_serial();
 
 /// Write to VDP serial port (UART)
 extern void vdp_write_serial(uint8_t c);
 
-/// Allow VDP to run internal processing (get keys etc)
+/// Allow VDP to run internal processing (get keys etc), buffered serial bytes are parsed in batches
 extern void vdp_tick();
 
+/// CPU cycles between batches of serial bytes parsed by vdp_tick(), 0 (the default) for once per scanline
+extern void vdp_set_link_cadence(uint32_t cycles);
+
 /// Tidy up VDP resources
 extern void vdp_shutdown();
 
@@ -0,0 +1,297 @@
+/*
+ * Headless throughput benchmark for the eZ80 core
+ *
+ * Boots a hex image against a null VDP, runs it for a fixed number of emulated cycles
+ * and reports emulated MHz, host ns per instruction and peak RSS. With -p the guest is
+ * also profiled and the flat and folded reports are written to profile.txt and profile.folded.
+ * With -F flash is kept in a file, once it exists the hex image is no longer parsed at startup.
+ * With -j the booted emulator is forked into that many children which run the benchmark side by side.
+ * With -t every memory and port access of the run is recorded for tools/tracestat, adding -P narrows
+ * that to an I/O trace of the listed ports. With -r the run is throttled to real time, so the host cpu
+ * time shows what idle and halted stretches cost.
+ *
+ * Usage: bench [-c cycles] [-f clock_hz] [-p interval] [-m file.map] [-F flash.bin] [-j forks] [-t trace.bin] [-P ports] [-r] [-v] [file.hex]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asic.h"
+#include "cpu.h"
+#include "emu.h"
+#include "profile.h"
+#include "schedule.h"
+#include "trace.h"
+#include "os/os.h"
+
+#include "utils.h"
+
+#define BENCH_DEFAULT_HEX    "MOS_debug.hex"
+#define BENCH_DEFAULT_CLOCK  18432000u     /* Agon Light eZ80F92 */
+#define BENCH_DEFAULT_CYCLES 184320000u    /* ten emulated seconds */
+#define BENCH_MAX_FORKS      64u
+
+#ifdef _WIN32
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif
+
+/* Null VDP: announce readiness with ESC like the real one, then stay silent and swallow output */
+static bool vdp_ready_sent = false;
+static uint64_t vdp_bytes_written = 0;
+
+uint8_t vdp_read_status_byte(void)
+{
+    return 0x40 | (vdp_ready_sent ? 0x00 : 0x01);
+}
+
+uint8_t vdp_read_serial(void)
+{
+    if (!vdp_ready_sent) {
+        vdp_ready_sent = true;
+        return 27;
+    }
+    return 0;
+}
+
+void vdp_write_serial(uint8_t c)
+{
+    (void)c;
+    vdp_bytes_written++;
+}
+
+void gui_console_clear(void) {}
+void gui_console_printf(const char *format, ...) { (void)format; }
+void gui_console_err_printf(const char *format, ...) { (void)format; }
+
+/* Restrict the trace to a comma separated list of ports and port ranges */
+static bool select_trace_ports(const char *list)
+{
+    char *end;
+
+    trace_select(TRACE_PORTS);
+    trace_select_ports(0x0000, 0xFFFF, false);
+    do {
+        unsigned long first = strtoul(list, &end, 0), last = first;
+        if (end == list) {
+            return false;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            last = strtoul(list, &end, 0);
+            if (end == list) {
+                return false;
+            }
+        }
+        if (first > last || last > 0xFFFF) {
+            return false;
+        }
+        trace_select_ports((uint16_t)first, (uint16_t)last, true);
+        list = end + 1;
+    } while (*end == ',');
+    return *end == '\0';
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-c cycles] [-f clock_hz] [-p interval] [-m file.map] [-F flash.bin] [-j forks] [-t trace.bin] [-P ports] [-r] [-v] [file.hex]\n", name);
+    fprintf(stderr, "  -c cycles    emulated cycles to run (default %u)\n", BENCH_DEFAULT_CYCLES);
+    fprintf(stderr, "  -f clock_hz  cpu clock (default %u)\n", BENCH_DEFAULT_CLOCK);
+    fprintf(stderr, "  -p interval  sample the guest pc every interval cycles\n");
+    fprintf(stderr, "  -m file.map  symbols for the profile\n");
+    fprintf(stderr, "  -F flash.bin keep flash in this file, created from the hex image\n");
+    fprintf(stderr, "  -j forks     run the benchmark in this many forks of the booted emulator\n");
+    fprintf(stderr, "  -t trace.bin record every memory and port access\n");
+    fprintf(stderr, "  -P ports     only record accesses to these ports, e.g. 0xC0-0xC7,0x86\n");
+    fprintf(stderr, "  -r           run no faster than real time\n");
+    fprintf(stderr, "  -v           keep the core's logging on stdout\n");
+}
+
+int main(int argc, char **argv)
+{
+    char *path = BENCH_DEFAULT_HEX, *map = NULL, *flash = NULL, *trace = NULL, *ports = NULL;
+    uint64_t budget = BENCH_DEFAULT_CYCLES, start_cycles, cycles, instructions;
+    uint32_t clock_hz = BENCH_DEFAULT_CLOCK, interval = 0, forks = 0, job = 0;
+    uint64_t start_ns, elapsed_ns, load_ns, fork_ns;
+    bool verbose = false, flash_exists = false, realtime = false;
+    clock_t cpu_time;
+    double seconds;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            budget = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            clock_hz = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            interval = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            map = argv[++i];
+        } else if (!strcmp(argv[i], "-F") && i + 1 < argc) {
+            flash = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            forks = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (!strcmp(argv[i], "-P") && i + 1 < argc) {
+            ports = argv[++i];
+        } else if (!strcmp(argv[i], "-r")) {
+            realtime = true;
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (argv[i][0] == '-' || i != argc - 1) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!budget || !clock_hz || (forks && (interval || trace)) || (ports && (!trace || !select_trace_ports(ports)))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* the core logs on stdout, keep it out of the measurement */
+    if (!verbose && !freopen(BENCH_NULL_DEVICE, "w", stdout)) {
+        fprintf(stderr, "bench: couldn't silence stdout\n");
+    }
+
+    load_ns = os_time_ns();
+    asic_free();
+    asic_init();
+    if (flash) {
+        FILE *file = fopen(flash, "rb");
+        if (file) {
+            /* an empty file is seeded from the hex image like a new one */
+            flash_exists = fgetc(file) != EOF;
+            fclose(file);
+        }
+        if (flash_exists && !emu_map(EMU_DATA_ROM, flash)) {
+            fprintf(stderr, "bench: couldn't map %s\n", flash);
+            asic_free();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!flash_exists) {
+        if (!loadHex(path)) {
+            fprintf(stderr, "bench: couldn't load %s\n", path);
+            asic_free();
+            return EXIT_FAILURE;
+        }
+        if (flash && !emu_map(EMU_DATA_ROM, flash)) {
+            fprintf(stderr, "bench: couldn't map %s\n", flash);
+        }
+    }
+    asic_reset();
+    load_ns = os_time_ns() - load_ns;
+    sched_set_clock(CLOCK_RUN, 1000);
+    set_cpu_clock(clock_hz);
+    sched_repeat(SCHED_RUN, 1);
+    if (map && !profile_load_symbols(map)) {
+        fprintf(stderr, "bench: couldn't load symbols from %s\n", map);
+    }
+    if (interval) {
+        profile_start(interval);
+    }
+
+    if (forks) {
+        int children[BENCH_MAX_FORKS];
+        int failed = 0;
+        if (forks > BENCH_MAX_FORKS) {
+            forks = BENCH_MAX_FORKS;
+        }
+        fork_ns = os_time_ns();
+        for (job = 1; job <= forks; job++) {
+            if ((children[job - 1] = emu_fork()) <= 0) {
+                break;
+            }
+        }
+        fork_ns = os_time_ns() - fork_ns;
+        if (job <= forks && children[job - 1] < 0) {
+            fprintf(stderr, "bench: couldn't fork\n");
+            forks = job - 1;
+            failed = 1;
+        }
+        if (job > forks) {
+            /* parent: the children do the work */
+            for (job = 0; job < forks; job++) {
+                failed |= os_wait_child(children[job]) != EXIT_SUCCESS;
+            }
+            fprintf(stderr, "bench: %u forks in %.3f ms\n", forks, fork_ns / 1e6);
+            asic_free();
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        /* buffer the report so it goes out in one piece instead of interleaving with the other forks */
+        setvbuf(stderr, NULL, _IOFBF, BUFSIZ);
+    }
+
+    if (trace && !trace_start(trace)) {
+        fprintf(stderr, "bench: couldn't trace to %s\n", trace);
+    }
+
+    start_cycles = sched_total_cycles();
+    instructions = cpu_instructions();
+    emu_set_throttle(realtime);
+    cpu_time = clock();
+    start_ns = os_time_ns();
+    while (cpu.abort != CPU_ABORT_EXIT && sched_total_cycles() - start_cycles < budget) {
+        sched.run_event_triggered = false;
+        sched_process_pending_events();
+        if (cpu.abort == CPU_ABORT_RESET) {
+            cpu_transition_abort(CPU_ABORT_RESET, CPU_ABORT_NONE);
+            asic_reset();
+        }
+        cpu_execute();
+        emu_throttle();
+    }
+    elapsed_ns = os_time_ns() - start_ns;
+    cpu_time = clock() - cpu_time;
+    if (trace_active) {
+        uint64_t records = trace_records();
+        if (!trace_stop()) {
+            fprintf(stderr, "bench: error writing %s\n", trace);
+        }
+        fprintf(stderr, "bench: traced %llu accesses to %s\n", (unsigned long long)records, trace);
+    }
+    cycles = sched_total_cycles() - start_cycles;
+    instructions = cpu_instructions() - instructions;
+    seconds = elapsed_ns / 1e9;
+
+    if (job) {
+        fprintf(stderr, "bench[%u]: %s at %.3f MHz\n", job, flash_exists ? flash : path, clock_hz / 1e6);
+    } else {
+        fprintf(stderr, "bench: %s at %.3f MHz\n", flash_exists ? flash : path, clock_hz / 1e6);
+    }
+    fprintf(stderr, "  startup       %.3f ms\n", load_ns / 1e6);
+    fprintf(stderr, "  host time     %.3f s (%.3f s cpu)\n", seconds, (double)cpu_time / CLOCKS_PER_SEC);
+    fprintf(stderr, "  emulated      %.3f s (%.2fx real time)\n", (double)cycles / clock_hz,
+            seconds > 0 ? (double)cycles / clock_hz / seconds : 0.0);
+    fprintf(stderr, "  speed         %.2f MHz\n", seconds > 0 ? cycles / seconds / 1e6 : 0.0);
+    fprintf(stderr, "  instructions  %llu (%.2f ns/instr)\n", (unsigned long long)instructions,
+            instructions ? (double)elapsed_ns / instructions : 0.0);
+    fprintf(stderr, "  vdp output    %llu bytes\n", (unsigned long long)vdp_bytes_written);
+    fprintf(stderr, "  peak rss      %llu KiB\n", (unsigned long long)(os_peak_rss() / 1024));
+
+    if (interval) {
+        FILE *file;
+        profile_stop();
+        if (!(file = fopen("profile.txt", "w")) || !profile_save_flat(file)) {
+            fprintf(stderr, "bench: couldn't write profile.txt\n");
+        }
+        if (file) {
+            fclose(file);
+        }
+        if (!(file = fopen("profile.folded", "w")) || !profile_save_folded(file)) {
+            fprintf(stderr, "bench: couldn't write profile.folded\n");
+        }
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    asic_free();
+    return EXIT_SUCCESS;
+}
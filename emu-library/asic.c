@@ -14,8 +14,11 @@
 #include "control.h"
 #include "schedule.h"
 #include "interrupt.h"
+#include "profile.h"
 #include "backlight.h"
 #include "realclock.h"
+#include "uart.h"
+#include "gpio.h"
 #include "defines.h"
 
 #include <stdio.h>
@@ -41,34 +44,29 @@ static void add_reset_proc(void (*proc)(void)) {
 }
 
 static void plug_devices(void) {
-
-		// JH - reset new port map
-		for (int i = 0; i < 256; i++)
-			{
-			port_map[i].read = NULL;
-			port_map[i].write = NULL;
-			}
-
-    /* Port ranges 0x0 -> 0xF */
-    port_map[0x0] = init_control();
-    port_map[0x1] = init_flash();
-    port_map[0x2] = init_sha256();
-    port_map[0x3] = init_usb();
-    port_map[0x4] = init_lcd();
-    port_map[0x5] = init_intrpt();
-    port_map[0x6] = init_watchdog();
-    //port_map[0x7] = init_gpt();							// Timers
-		port_map[0x86] = init_gpt();							// JH
-		port_map[0x87] = init_gpt();
-		port_map[0x88] = init_gpt();
-    port_map[0x8] = init_rtc();
-    port_map[0x9] = init_protected();
-    port_map[0xA] = init_keypad();
-    port_map[0xB] = init_backlight();
-    port_map[0xC] = init_cxxx();
-    port_map[0xD] = init_spi();
-    port_map[0xE] = init_exxx();
-    port_map[0xF] = init_fxxx();
+    port_map_clear();
+
+    /* CE devices kept from the original core, each answering on the single port of its old range */
+    port_map_range(0x0, 0x0, init_control(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x1, 0x1, init_flash(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x2, 0x2, init_sha256(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x3, 0x3, init_usb(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x4, 0x4, init_lcd(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x5, 0x5, init_intrpt(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x6, 0x6, init_watchdog(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x8, 0x8, init_rtc(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0x9, 0x9, init_protected(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xA, 0xA, init_keypad(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xB, 0xB, init_backlight(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xC, 0xC, init_cxxx(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xD, 0xD, init_spi(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xE, 0xE, init_exxx(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+    port_map_range(0xF, 0xF, init_fxxx(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);
+
+    /* eZ80F92 internal I/O */
+    port_map_range(0x80, 0x92, init_prt(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);     /* TMR0_CTL .. TMR_ISS */
+    port_map_range(0x9A, 0xA5, init_gpio(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);    /* PB_DR .. PD_ALT2 */
+    port_map_range(0xC0, 0xC7, init_uart0(), PORT_DEFAULT_CYCLES, PORT_DEFAULT_CYCLES);   /* UART0 */
 
     reset_proc_count = 0;
 
@@ -77,16 +75,19 @@ static void plug_devices(void) {
     add_reset_proc(mem_reset);
     add_reset_proc(lcd_reset);
     add_reset_proc(keypad_reset);
-    add_reset_proc(gpt_reset);
+    add_reset_proc(prt_reset);
     add_reset_proc(rtc_reset);
     add_reset_proc(watchdog_reset);
     add_reset_proc(cpu_reset);
     add_reset_proc(intrpt_reset);
+    add_reset_proc(uart0_reset);
+    add_reset_proc(gpio_reset);
     add_reset_proc(sha256_reset);
     add_reset_proc(usb_reset);
     add_reset_proc(control_reset);
     add_reset_proc(backlight_reset);
     add_reset_proc(spi_reset);
+    add_reset_proc(profile_reset);
 
     printf("[eZ80-Emu] Initialized Advanced Peripheral Bus...\n");
 }
@@ -132,7 +133,7 @@ void set_cpu_clock(uint32_t new_rate) {
    sched_set_clock(CLOCK_CPU, new_rate);
 }
 
-bool asic_restore(FILE *image) {
+bool asic_restore(FILE *image, bool delta) {
     return fread(&asic.device, sizeof(asic.device), 1, image) == 1
            && backlight_restore(image)
            && control_restore(image)
@@ -141,21 +142,23 @@ bool asic_restore(FILE *image) {
            && intrpt_restore(image)
            && keypad_restore(image)
            && lcd_restore(image)
-           && mem_restore(image)
+           && mem_restore(image, delta)
            && watchdog_restore(image)
            && protect_restore(image)
            && rtc_restore(image)
            && sha256_restore(image)
-           && gpt_restore(image)
+           && prt_restore(image)
            && usb_restore(image)
            && cxxx_restore(image)
            && spi_restore(image)
            && exxx_restore(image)
+           && uart0_restore(image)
+           && gpio_restore(image)
            && sched_restore(image)
            && fgetc(image) == EOF;
 }
 
-bool asic_save(FILE *image) {
+bool asic_save(FILE *image, bool delta) {
     return fwrite(&asic.device, sizeof(asic.device), 1, image) == 1
            && backlight_save(image)
            && control_save(image)
@@ -164,15 +167,17 @@ bool asic_save(FILE *image) {
            && intrpt_save(image)
            && keypad_save(image)
            && lcd_save(image)
-           && mem_save(image)
+           && mem_save(image, delta)
            && watchdog_save(image)
            && protect_save(image)
            && rtc_save(image)
            && sha256_save(image)
-           && gpt_save(image)
+           && prt_save(image)
            && usb_save(image)
            && cxxx_save(image)
            && spi_save(image)
            && exxx_save(image)
+           && uart0_save(image)
+           && gpio_save(image)
            && sched_save(image);
 }
@@ -23,8 +23,8 @@ extern asic_state_t asic;
 void asic_init(void);
 void asic_free(void);
 void asic_reset(void);
-bool asic_restore(FILE *image);
-bool asic_save(FILE *image);
+bool asic_restore(FILE *image, bool delta);
+bool asic_save(FILE *image, bool delta);
 void set_cpu_clock(uint32_t new_rate);
 void set_device_type(ti_device_t device);
 ti_device_t get_device_type(void);
@@ -171,6 +171,7 @@ static void control_write(const uint16_t pio, const uint8_t byte, bool poke) {
                 for (i = LCD_RAM_OFFSET; i < LCD_RAM_OFFSET + LCD_BYTE_SIZE; i++) {
                     mem.ram.block[i] = bus_rand();
                 }
+                mem_dirty_range(MEM_RAM_BASE + LCD_RAM_OFFSET, LCD_BYTE_SIZE);
             } else {
                 lcd_update();
             }
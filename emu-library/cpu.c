@@ -25,6 +25,7 @@
 #include "control.h"
 #include "registers.h"
 #include "schedule.h"
+#include "trace.h"
 #include "interrupt.h"
 #include "debug/debug.h"
 
@@ -35,6 +36,95 @@
 /* Global CPU state */
 eZ80cpu_t cpu;
 
+/* Lazy flags
+ *
+ * ALU, INC and DEC only record their operands and result, F is computed from them when something
+ * actually reads it.  Everything that reads F (the interpreter, PUSH AF, interrupts, the debugger,
+ * leaving cpu_execute) calls cpu_flags_materialize() first, cpu_read_cc() can answer S, Z and C
+ * straight from the recorded result.
+ */
+enum cpu_flags_op {
+    CPU_FLAGS_VALID,                             /* F is up to date */
+    CPU_FLAGS_ADD, CPU_FLAGS_ADC, CPU_FLAGS_SUB, CPU_FLAGS_SBC,
+    CPU_FLAGS_AND, CPU_FLAGS_XOR, CPU_FLAGS_OR, CPU_FLAGS_CP,
+    CPU_FLAGS_INC, CPU_FLAGS_DEC
+};
+
+static struct {
+    uint8_t op;
+    uint8_t a;                                   /* first operand */
+    uint8_t v;                                   /* second operand */
+    uint8_t carry;                               /* carry in, or carry to keep for INC/DEC */
+    uint8_t result;
+} cpu_flags;
+
+static void cpu_flags_record(enum cpu_flags_op op, uint8_t a, uint8_t v, uint8_t carry, uint8_t result) {
+    cpu_flags.op = op;
+    cpu_flags.a = a;
+    cpu_flags.v = v;
+    cpu_flags.carry = carry;
+    cpu_flags.result = result;
+}
+
+static bool cpu_flags_carry(void) {
+    int a = cpu_flags.a, v = cpu_flags.v, c = cpu_flags.carry;
+    switch (cpu_flags.op) {
+        case CPU_FLAGS_VALID: return cpu.registers.flags.C;
+        case CPU_FLAGS_ADD:   return (a + v) & 0x100;
+        case CPU_FLAGS_ADC:   return (a + v + c) & 0x100;
+        case CPU_FLAGS_SUB:
+        case CPU_FLAGS_CP:    return (a - v) & 0x100;
+        case CPU_FLAGS_SBC:   return (a - v - c) & 0x100;
+        case CPU_FLAGS_INC:
+        case CPU_FLAGS_DEC:   return c;
+        default:              return false;
+    }
+}
+
+static void cpu_flags_compute(void) {
+    eZ80registers_t *r = &cpu.registers;
+    uint8_t a = cpu_flags.a, v = cpu_flags.v, c = cpu_flags.carry, result = cpu_flags.result;
+    uint8_t f = cpuflag_sign_b(result) | cpuflag_zero(result) | cpuflag_undef(r->F);
+    switch (cpu_flags.op) {
+        case CPU_FLAGS_ADD:
+        case CPU_FLAGS_ADC:
+            f |= cpuflag_overflow_b_add(a, v, result)
+                | cpuflag_subtract(0) | cpuflag_carry_b(a + v + c)
+                | cpuflag_halfcarry_b_add(a, v, c);
+            break;
+        case CPU_FLAGS_SUB:
+        case CPU_FLAGS_SBC:
+        case CPU_FLAGS_CP:
+            f |= cpuflag_overflow_b_sub(a, v, result)
+                | cpuflag_subtract(1) | cpuflag_carry_b(a - v - c)
+                | cpuflag_halfcarry_b_sub(a, v, c);
+            break;
+        case CPU_FLAGS_AND:
+            f |= cpuflag_parity(result) | FLAG_H;
+            break;
+        case CPU_FLAGS_XOR:
+        case CPU_FLAGS_OR:
+            f |= cpuflag_parity(result);
+            break;
+        case CPU_FLAGS_INC:
+            f |= cpuflag_c(c) | cpuflag_halfcarry_b_add(a, 0, 1)
+                | cpuflag_pv(result == 0x80) | cpuflag_subtract(0);
+            break;
+        case CPU_FLAGS_DEC:
+            f |= cpuflag_c(c) | cpuflag_halfcarry_b_sub(a, 0, 1)
+                | cpuflag_pv(a == 0x80) | cpuflag_subtract(1);
+            break;
+    }
+    r->F = f;
+    cpu_flags.op = CPU_FLAGS_VALID;
+}
+
+static inline void cpu_flags_materialize(void) {
+    if (cpu_flags.op != CPU_FLAGS_VALID) {
+        cpu_flags_compute();
+    }
+}
+
 static void cpu_clear_context(void) {
     cpu.PREFIX = cpu.SUFFIX = 0;
     cpu.L = cpu.ADL;
@@ -44,6 +134,7 @@ static void cpu_clear_context(void) {
 static void cpu_inst_start(void) {
     cpu_clear_context();
 #ifdef DEBUG_SUPPORT
+    cpu_flags_materialize();
     debug_inst_start();
 #endif
 }
@@ -95,69 +186,147 @@ static uint32_t cpu_fetch_word_no_prefetch(void) {
     return value;
 }
 
+/* The _mode variants take the data width as a parameter, so callers that know it at compile time
+ * (the decoded ADL and Z80 handlers) don't test cpu.L on every access */
+static inline uint8_t cpu_read_byte_mode(uint32_t address, bool mode) {
+    return mem_read_cpu(cpu_address_mode(address, mode), false);
+}
+static inline void cpu_write_byte_mode(uint32_t address, uint8_t value, bool mode) {
+    mem_write_cpu(cpu_address_mode(address, mode), value);
+}
 static uint8_t cpu_read_byte(uint32_t address) {
-    uint32_t cpuAddress = cpu_address_mode(address, cpu.L);
-    return mem_read_cpu(cpuAddress, false);
+    return cpu_read_byte_mode(address, cpu.L);
 }
 static void cpu_write_byte(uint32_t address, uint8_t value) {
-    uint32_t cpuAddress = cpu_address_mode(address, cpu.L);
-    mem_write_cpu(cpuAddress, value);
+    cpu_write_byte_mode(address, value, cpu.L);
 }
 
-static uint32_t cpu_read_word(uint32_t address) {
-    uint32_t value = cpu_read_byte(address);
-    value |= cpu_read_byte(address + 1) << 8;
-    if (cpu.L) {
-        value |= cpu_read_byte(address + 2) << 16;
+static inline uint32_t cpu_read_word_mode(uint32_t address, bool mode) {
+    uint32_t value = cpu_read_byte_mode(address, mode);
+    value |= cpu_read_byte_mode(address + 1, mode) << 8;
+    if (mode) {
+        value |= cpu_read_byte_mode(address + 2, mode) << 16;
     }
     return value;
 }
-static void cpu_write_word(uint32_t address, uint32_t value) {
-    cpu_write_byte(address, value);
-    cpu_write_byte(address + 1, value >> 8);
-    if (cpu.L) {
-        cpu_write_byte(address + 2, value >> 16);
+static inline void cpu_write_word_mode(uint32_t address, uint32_t value, bool mode) {
+    cpu_write_byte_mode(address, value, mode);
+    cpu_write_byte_mode(address + 1, value >> 8, mode);
+    if (mode) {
+        cpu_write_byte_mode(address + 2, value >> 16, mode);
     }
 }
+static uint32_t cpu_read_word(uint32_t address) {
+    return cpu_read_word_mode(address, cpu.L);
+}
+static void cpu_write_word(uint32_t address, uint32_t value) {
+    cpu_write_word_mode(address, value, cpu.L);
+}
 
-static uint8_t cpu_pop_byte_mode(bool mode) {
+static inline uint8_t cpu_pop_byte_mode(bool mode) {
     return mem_read_cpu(cpu_address_mode(cpu.registers.stack[mode].hl++, mode), false);
 }
-static uint8_t cpu_pop_byte(void) {
-    return cpu_pop_byte_mode(cpu.L);
-}
-static void cpu_push_byte_mode(uint8_t value, bool mode) {
+static inline void cpu_push_byte_mode(uint8_t value, bool mode) {
     mem_write_cpu(cpu_address_mode(--cpu.registers.stack[mode].hl, mode), value);
 }
-static void cpu_push_byte(uint8_t value) {
-    cpu_push_byte_mode(value, cpu.L);
-}
 
-static void cpu_push_word(uint32_t value) {
-    if (cpu.L) {
-        cpu_push_byte(value >> 16);
+static inline void cpu_push_word_mode(uint32_t value, bool mode) {
+    if (mode) {
+        cpu_push_byte_mode(value >> 16, mode);
     }
-    cpu_push_byte(value >> 8);
-    cpu_push_byte(value);
+    cpu_push_byte_mode(value >> 8, mode);
+    cpu_push_byte_mode(value, mode);
+}
+static void cpu_push_word(uint32_t value) {
+    cpu_push_word_mode(value, cpu.L);
 }
 
-static uint32_t cpu_pop_word(void) {
-    uint32_t value = cpu_pop_byte();
-    value |= cpu_pop_byte() << 8;
-    if (cpu.L) {
-        value |= cpu_pop_byte() << 16;
+static inline uint32_t cpu_pop_word_mode(bool mode) {
+    uint32_t value = cpu_pop_byte_mode(mode);
+    value |= cpu_pop_byte_mode(mode) << 8;
+    if (mode) {
+        value |= cpu_pop_byte_mode(mode) << 16;
     }
     return value;
 }
+static uint32_t cpu_pop_word(void) {
+    return cpu_pop_word_mode(cpu.L);
+}
+
+/* Polling loops
+ *
+ * Code waiting on a status port (MOS spinning on IN0 A,(0xC5) for UART data) re-reads the same port
+ * from the same state over and over.  If a port read finds every register, the value read and RAM
+ * exactly as they were at the previous port read, nothing in between could have had a side effect,
+ * so every iteration until the next event will be identical.  Those iterations are skipped by only
+ * advancing the cycle count (and R) by whole loop periods, leaving the final partial iteration to run.
+ */
+static struct {
+    bool valid;
+    uint16_t pio;
+    uint8_t value;
+    uint32_t cycles;
+    uint32_t writes;                             /* mem.writes at the snapshot */
+    eZ80registers_t registers;
+    bool IEF1, IEF2, ADL, MADL;
+} cpu_idle;
+
+/* The fast paths skip over instructions and accesses, which the debugger may be waiting for */
+static inline bool cpu_debug_active(void) {
+#ifdef DEBUG_SUPPORT
+    return debug_active();
+#else
+    return false;
+#endif
+}
+
+static void cpu_idle_poll(uint16_t pio, uint8_t value) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t period = cpu.cycles - cpu_idle.cycles;
+    uint8_t refresh = r->R - cpu_idle.registers.R;
+    uint8_t R = r->R;
+
+    if (cpu_debug_active()) {
+        cpu_idle.valid = false;
+        return;
+    }
+    cpu_flags_materialize();
+    r->R = cpu_idle.registers.R;
+    if (cpu_idle.valid && cpu_idle.pio == pio && cpu_idle.value == value &&
+        cpu_idle.writes == mem.writes && period && cpu.cycles < cpu.next &&
+        cpu_idle.IEF1 == cpu.IEF1 && cpu_idle.IEF2 == cpu.IEF2 &&
+        cpu_idle.ADL == cpu.ADL && cpu_idle.MADL == cpu.MADL &&
+        !memcmp(r, &cpu_idle.registers, sizeof(*r))) {
+        uint32_t skip = (cpu.next - cpu.cycles) / period;
+        cpu.cycles += skip * period;
+        R += skip * refresh;
+    }
+    r->R = R;
+
+    cpu_idle.valid = true;
+    cpu_idle.pio = pio;
+    cpu_idle.value = value;
+    cpu_idle.cycles = cpu.cycles;
+    cpu_idle.writes = mem.writes;
+    cpu_idle.registers = *r;
+    cpu_idle.IEF1 = cpu.IEF1;
+    cpu_idle.IEF2 = cpu.IEF2;
+    cpu_idle.ADL = cpu.ADL;
+    cpu_idle.MADL = cpu.MADL;
+}
 
 static uint8_t cpu_read_in(uint16_t pio) {
+    uint8_t value;
     if (unprivileged_code()) {
         return 0; /* in returns 0 in unprivileged code */
     }
-    return port_read_byte(pio);
+    value = port_read_byte(pio);
+    cpu_idle_poll(pio, value);
+    return value;
 }
 
 static void cpu_write_out(uint16_t pio, uint8_t value) {
+    cpu_idle.valid = false;
     if (unprivileged_code()) {
         control.protectionStatus |= 2;
         printf("[eZ80-Emu] NMI reset cause by an out instruction in unpriviledged code.\n");
@@ -335,6 +504,17 @@ static void cpu_write_rp3(int i, uint32_t value) {
 }
 
 static bool cpu_read_cc(const int i) {
+    if (cpu_flags.op != CPU_FLAGS_VALID) {
+        switch (i) {
+            case 0: return cpu_flags.result != 0;
+            case 1: return cpu_flags.result == 0;
+            case 2: return !cpu_flags_carry();
+            case 3: return cpu_flags_carry();
+            case 6: return !(cpu_flags.result & 0x80);
+            case 7: return cpu_flags.result & 0x80;
+            default: cpu_flags_compute(); break;
+        }
+    }
     switch (i) {
         case 0: return !cpu.registers.flags.Z;
         case 1: return  cpu.registers.flags.Z;
@@ -439,67 +619,52 @@ static void cpu_return(void) {
     cpu_jump(address, mode);
 }
 
+/* cpu_call(address, false) and an unsuffixed cpu_return() for a known mode */
+static inline void cpu_call_mode(uint32_t address, bool mode) {
+#ifdef DEBUG_SUPPORT
+    debug_record_call(cpu.registers.PC, mode);
+#endif
+    cpu_push_word_mode(cpu.registers.PC, mode);
+    cpu_prefetch(address, mode);
+}
+static inline void cpu_return_mode(bool mode) {
+    cpu.cycles++;
+    cpu_jump(cpu_pop_word_mode(mode), mode);
+}
+
 static void cpu_execute_alu(int i, uint8_t v) {
-    uint8_t old;
     eZ80registers_t *r = &cpu.registers;
+    uint8_t old = r->A, carry = 0, result = 0;
     switch (i) {
         case 0: /* ADD A, v */
-            old = r->A;
-            r->A += v;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_overflow_b_add(old, v, r->A)
-                | cpuflag_subtract(0) | cpuflag_carry_b(old + v)
-                | cpuflag_halfcarry_b_add(old, v, 0);
+            result = old + v;
             break;
         case 1: /* ADC A, v */
-            old = r->A;
-            r->A += v + r->flags.C;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_overflow_b_add(old, v, r->A)
-                | cpuflag_subtract(0) | cpuflag_carry_b(old + v + r->flags.C)
-                | cpuflag_halfcarry_b_add(old, v, r->flags.C);
+            carry = cpu_flags_carry();
+            result = old + v + carry;
             break;
         case 2: /* SUB v */
-            old = r->A;
-            r->A -= v;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_overflow_b_sub(old, v, r->A)
-                | cpuflag_subtract(1) | cpuflag_carry_b(old - v)
-                | cpuflag_halfcarry_b_sub(old, v, 0);
+        case 7: /* CP v */
+            result = old - v;
             break;
         case 3: /* SBC v */
-            old = r->A;
-            r->A -= v + r->flags.C;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_overflow_b_sub(old, v, r->A)
-                | cpuflag_subtract(1) | cpuflag_carry_b(old - v - r->flags.C)
-                | cpuflag_halfcarry_b_sub(old, v, r->flags.C);
+            carry = cpu_flags_carry();
+            result = old - v - carry;
             break;
         case 4: /* AND v */
-            r->A &= v;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_parity(r->A)
-                | FLAG_H;
+            result = old & v;
             break;
         case 5: /* XOR v */
-            r->A ^= v;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_parity(r->A);
+            result = old ^ v;
             break;
         case 6: /* OR v */
-            r->A |= v;
-            r->F = cpuflag_sign_b(r->A) | cpuflag_zero(r->A)
-                | cpuflag_undef(r->F) | cpuflag_parity(r->A);
-            break;
-        case 7: /* CP v */
-            old = r->A - v;
-            r->F = cpuflag_sign_b(old) | cpuflag_zero(old)
-                | cpuflag_undef(r->F) | cpuflag_subtract(1)
-                | cpuflag_carry_b(r->A - v)
-                | cpuflag_overflow_b_sub(r->A, v, old)
-                | cpuflag_halfcarry_b_sub(r->A, v, 0);
+            result = old | v;
             break;
     }
+    if (i != 7) {
+        r->A = result;
+    }
+    cpu_flags_record(CPU_FLAGS_ADD + i, old, v, carry, result);
 }
 
 static void cpu_execute_rot(int y, int z, uint32_t address, uint8_t value) {
@@ -605,6 +770,169 @@ static void cpu_execute_rot_acc(int y)
     }
 }
 
+static void cpu_execute_add_index(int p) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t old_word = cpu_mask_mode(cpu_read_index(), cpu.L);
+    uint32_t op_word = cpu_mask_mode(cpu_read_rp(p), cpu.L);
+    uint32_t new_word = old_word + op_word;
+    cpu_write_index(cpu_mask_mode(new_word, cpu.L));
+    r->F = cpuflag_s(r->flags.S) | cpuflag_zero(!r->flags.Z)
+        | cpuflag_undef(r->F) | cpuflag_pv(r->flags.PV)
+        | cpuflag_subtract(0) | cpuflag_carry_w(new_word, cpu.L)
+        | cpuflag_halfcarry_w_add(old_word, op_word, 0);
+}
+
+static void cpu_execute_inc(int y, uint32_t address) {
+    uint8_t old = cpu_read_reg_prefetched(y, address);
+    uint8_t new = old + 1;
+    cpu_write_reg_prefetched(y, address, new);
+    cpu_flags_record(CPU_FLAGS_INC, old, 0, cpu_flags_carry(), new);
+}
+
+static void cpu_execute_dec(int y, uint32_t address) {
+    uint8_t old = cpu_read_reg_prefetched(y, address);
+    uint8_t new = old - 1;
+    cpu_write_reg_prefetched(y, address, new);
+    cpu_flags_record(CPU_FLAGS_DEC, old, 0, cpu_flags_carry(), new);
+}
+
+static void cpu_execute_exx(void) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t w;
+    w = r->BC;
+    r->BC = r->_BC;
+    r->_BC = w;
+    w = r->DE;
+    r->DE = r->_DE;
+    r->_DE = w;
+    w = r->HL;
+    r->HL = r->_HL;
+    r->_HL = w;
+}
+
+static void cpu_execute_ex_sp(void) {
+    uint32_t address = cpu_read_sp();
+    uint32_t old_word = cpu_read_word(address);
+    uint32_t new_word = cpu_read_index();
+    cpu_write_index(old_word);
+    cpu_write_word(address, new_word);
+}
+
+static void cpu_execute_adc_sbc(int q, int p) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t old_word = cpu_mask_mode(r->HL, cpu.L);
+    uint32_t op_word = cpu_mask_mode(cpu_read_rp(p), cpu.L);
+    int32_t sw;
+    if (q == 0) { /* SBC HL, rp[p] */
+        r->HL = cpu_mask_mode(sw = (int32_t)old_word - (int32_t)op_word - r->flags.C, cpu.L);
+        r->F = cpuflag_sign_w(r->HL, cpu.L) | cpuflag_zero(r->HL)
+            | cpuflag_undef(r->F) | cpuflag_overflow_w_sub(old_word, op_word, r->HL, cpu.L)
+            | cpuflag_subtract(1) | cpuflag_carry_w(sw, cpu.L)
+            | cpuflag_halfcarry_w_sub(old_word, op_word, r->flags.C);
+    } else { /* ADC HL, rp[p] */
+        r->HL = cpu_mask_mode(sw = (int32_t)old_word + (int32_t)op_word + r->flags.C, cpu.L);
+        r->F = cpuflag_sign_w(sw, cpu.L) | cpuflag_zero(r->HL)
+            | cpuflag_undef(r->F) | cpuflag_overflow_w_add(old_word, op_word, r->HL, cpu.L)
+            | cpuflag_subtract(0) | cpuflag_carry_w(sw, cpu.L)
+            | cpuflag_halfcarry_w_add(old_word, op_word, r->flags.C);
+    }
+}
+
+static void cpu_execute_in0(int y, uint8_t port) {
+    eZ80registers_t *r = &cpu.registers;
+    uint8_t new = cpu_read_in(port);
+    if (y != 6) {
+        cpu_write_reg(y, new);
+    }
+    r->F = cpuflag_sign_b(new) | cpuflag_zero(new)
+        | cpuflag_undef(r->F) | cpuflag_parity(new)
+        | cpuflag_c(r->flags.C);
+}
+
+/* Copy count bytes from src to dst one at a time, in the direction of delta.  Overlapping ranges that
+ * would read back bytes written by the same transfer repeat the first distance bytes, like the hardware. */
+static void cpu_block_copy(uint8_t *dst, const uint8_t *src, uint32_t count, int_fast8_t delta) {
+    uint32_t distance = delta > 0 ? (uint32_t)(dst - src) : (uint32_t)(src - dst);
+    uint32_t done, size;
+    if (dst == src || distance >= count) {
+        memmove(delta > 0 ? dst : dst - count + 1, delta > 0 ? src : src - count + 1, count);
+    } else if (distance == 1) {
+        memset(delta > 0 ? dst : dst - count + 1, *src, count);
+    } else if (delta > 0) {
+        memcpy(dst, src, distance);
+        for (done = distance; done < count; done += size) {
+            size = done < count - done ? done : count - done;
+            memcpy(dst + done, dst, size);
+        }
+    } else {
+        memcpy(dst - distance + 1, src - distance + 1, distance);
+        for (done = distance; done < count; done += size) {
+            size = done < count - done ? done : count - done;
+            memcpy(dst - done - size + 1, dst - size + 1, size);
+        }
+    }
+}
+
+/* LDIR, LDDR as a single host copy when both ranges are plain memory, returns false to use the byte loop.
+ * Each iteration takes one cycle, so as many iterations run as fit before the next event. */
+static bool cpu_execute_bli_copy(int_fast8_t delta) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t mask = cpu.L ? 0xFFFFFF : 0xFFFF;
+    uint32_t hl = r->HL & mask, de = r->DE & mask, bc;
+    uint32_t count = ((r->BC - 1) & mask) + 1;
+    uint32_t budget = cpu.cycles < cpu.next ? cpu.next - cpu.cycles : 1;
+    uint32_t src, dst, limit;
+    const uint8_t *from;
+    uint8_t *to;
+
+    if (count > budget) {
+        count = budget;
+    }
+    /* stop short of HL or DE wrapping around, the byte loop handles the wrap */
+    limit = delta > 0 ? mask + 1 - (hl > de ? hl : de) : (hl < de ? hl : de) + 1;
+    if (count > limit) {
+        count = limit;
+    }
+    /* a memory trace wants every byte */
+    if (count < 2 || (trace_kinds & TRACE_MEMORY)) {
+        return false;
+    }
+    src = cpu_address_mode(hl, cpu.L);
+    dst = cpu_address_mode(de, cpu.L);
+    if (delta > 0) {
+        from = mem_fetch_ptr(src, count);
+        to = mem_cpu_ptr(dst, count);
+    } else {
+        from = mem_fetch_ptr(src - count + 1, count);
+        to = mem_cpu_ptr(dst - count + 1, count);
+        from += from ? count - 1 : 0;
+        to += to ? count - 1 : 0;
+    }
+    if (!from || !to) {
+        return false;
+    }
+
+    cpu_block_copy(to, from, count, delta);
+    mem.writes++;
+    mem_dirty_range(delta > 0 ? dst : dst - count + 1, count);
+    cpu_decode_invalidate_range(delta > 0 ? dst : dst - count + 1, count);
+
+    r->HL = cpu_mask_mode((int32_t)hl + delta * (int32_t)count, cpu.L);
+    r->DE = cpu_mask_mode((int32_t)de + delta * (int32_t)count, cpu.L);
+    bc = cpu_mask_mode((int32_t)r->BC - (int32_t)count, cpu.L);
+    if (cpu.L) {
+        r->BC = bc;
+    } else {
+        r->BCS = bc;
+    }
+    r->flags.H = 0;
+    r->flags.PV = bc != 0;
+    r->flags.N = 0;
+    cpu.cycles += count;
+    cpu.inBlock = r->flags.PV;
+    return true;
+}
+
 static void cpu_execute_bli() {
     eZ80registers_t *r = &cpu.registers;
     uint8_t old, new = 0;
@@ -612,6 +940,10 @@ static void cpu_execute_bli() {
     uint_fast8_t xp = cpu.context.x << 2 | cpu.context.p;
     int_fast8_t delta = cpu.context.q ? -1 : 1;
     bool repeat = (cpu.context.x | cpu.context.p) & 1;
+    /* the debugger wants to see every iteration and every access */
+    if (!cpu.context.z && xp == 0xB && !cpu_debug_active() && cpu_execute_bli_copy(delta)) {
+        return;
+    }
     do {
 #ifdef DEBUG_SUPPORT
         if (cpu.inBlock) {
@@ -756,9 +1088,981 @@ static void cpu_execute_bli() {
     } while ((cpu.inBlock = repeat) && cpu.cycles < cpu.next);
 }
 
+/* Decoded instruction cache
+ *
+ * Instructions are decoded once into a handler plus their immediate operand, keyed by the 24-bit PC
+ * and the ADL bit.  Entries are invalidated by cpu_decode_invalidate() whenever code bytes are
+ * written.  Anything not handled here (suffixes, HALT, 0xCB, block and rarer prefixed opcodes)
+ * falls back to the interpreter.
+ */
+#define CPU_DECODE_BITS       14
+#define CPU_DECODE_SIZE       (1 << CPU_DECODE_BITS)
+#define CPU_DECODE_MASK       (CPU_DECODE_SIZE - 1)
+#define CPU_DECODE_PAGE_SHIFT 8
+#define CPU_DECODE_EMPTY      (~UINT32_C(0))
+#define CPU_DECODE_BRANCH     (1 << 0)        /* ends a superblock */
+#define CPU_DECODE_FLAGS      (1 << 1)        /* uses F directly, lazy flags are materialized first */
+
+typedef struct cpu_decoded cpu_decoded_t;
+
+struct cpu_decoded {
+    uint32_t tag;                                /* PC | ADL << 24 */
+    uint32_t imm;                                /* immediate word, byte or offset */
+    void (*handler)(const cpu_decoded_t *);      /* NULL if the interpreter must run it */
+    eZ80context_t context;
+    uint8_t length;
+    uint8_t flags;
+    uint8_t prefix;                              /* cpu.PREFIX while it runs, 2 = IX, 3 = IY */
+    uint8_t refresh;                             /* R increment, 2 per opcode byte */
+    uint8_t bytes[5];
+};
+
+/* Superblocks
+ *
+ * Straight-line runs of decoded instructions starting at a hot PC and ending at the first branch.
+ * Blocks are chained to their last successor so hot loops run without going back through the
+ * interpreter loop, stopping as soon as cpu.next is reached, which also covers pending interrupts.
+ */
+#define CPU_BLOCK_BITS        11
+#define CPU_BLOCK_SIZE        (1 << CPU_BLOCK_BITS)
+#define CPU_BLOCK_MASK        (CPU_BLOCK_SIZE - 1)
+#define CPU_BLOCK_OPS         16              /* max instructions in a block */
+#define CPU_BLOCK_SPAN        64              /* max bytes covered by a block */
+#define CPU_BLOCK_HOT         32              /* executions before a block is built */
+
+typedef struct cpu_block cpu_block_t;
+
+struct cpu_block {
+    uint32_t tag;                                /* start PC | ADL << 24 */
+    uint32_t candidate;                          /* PC being counted towards a block */
+    uint16_t heat;
+    uint8_t count;
+    uint8_t span;
+    cpu_block_t *link;                           /* last successor chained to */
+    cpu_decoded_t ops[CPU_BLOCK_OPS];
+};
+
+static struct {
+    cpu_decoded_t entry[CPU_DECODE_SIZE];
+    cpu_block_t block[CPU_BLOCK_SIZE];
+    uint8_t pages[(1 << 24 >> CPU_DECODE_PAGE_SHIFT) / 8];
+} cpu_decode;
+
+void cpu_decode_flush(void) {
+    unsigned int i;
+    for (i = 0; i < CPU_DECODE_SIZE; i++) {
+        cpu_decode.entry[i].tag = CPU_DECODE_EMPTY;
+    }
+    for (i = 0; i < CPU_BLOCK_SIZE; i++) {
+        cpu_block_t *block = &cpu_decode.block[i];
+        block->tag = block->candidate = CPU_DECODE_EMPTY;
+        block->heat = 0;
+        block->link = NULL;
+    }
+    memset(cpu_decode.pages, 0, sizeof(cpu_decode.pages));
+    cpu_idle.valid = false;
+}
+
+void cpu_decode_invalidate(uint32_t address) {
+    uint32_t page = address >> CPU_DECODE_PAGE_SHIFT;
+    uint_fast8_t i;
+    if (likely(!(cpu_decode.pages[page >> 3] & (1 << (page & 7))))) {
+        return;
+    }
+    for (i = 0; i < sizeof(cpu_decode.entry->bytes); i++) {
+        uint32_t start = (address - i) & 0xFFFFFF;
+        cpu_decoded_t *entry = &cpu_decode.entry[start & CPU_DECODE_MASK];
+        if ((entry->tag & 0xFFFFFF) == start && entry->length > i) {
+            entry->tag = CPU_DECODE_EMPTY;
+        }
+    }
+    for (i = 0; i < CPU_BLOCK_SPAN; i++) {
+        uint32_t start = (address - i) & 0xFFFFFF;
+        cpu_block_t *block = &cpu_decode.block[start & CPU_BLOCK_MASK];
+        if ((block->tag & 0xFFFFFF) == start && block->span > i) {
+            block->tag = CPU_DECODE_EMPTY;
+        }
+    }
+}
+
+void cpu_decode_invalidate_range(uint32_t address, uint32_t size) {
+    while (size) {
+        uint32_t page = (address & 0xFFFFFF) >> CPU_DECODE_PAGE_SHIFT;
+        uint32_t chunk = (1 << CPU_DECODE_PAGE_SHIFT) - (address & ((1 << CPU_DECODE_PAGE_SHIFT) - 1));
+        if (chunk > size) {
+            chunk = size;
+        }
+        if (cpu_decode.pages[page >> 3] & (1 << (page & 7))) {
+            uint32_t i;
+            for (i = 0; i < chunk; i++) {
+                cpu_decode_invalidate(address + i);
+            }
+        }
+        address += chunk;
+        size -= chunk;
+    }
+}
+
+static void cpu_decode_mark(uint32_t address) {
+    uint32_t page = (address & 0xFFFFFF) >> CPU_DECODE_PAGE_SHIFT;
+    cpu_decode.pages[page >> 3] |= 1 << (page & 7);
+}
+
+/* Replays the side effects of fetching the operand bytes */
+static void cpu_decode_fetch(const cpu_decoded_t *d) {
+    uint_fast8_t i;
+#ifdef DEBUG_SUPPORT
+    uint32_t pc = cpu.registers.PC;
+    for (i = 0; i < d->length; i++) {
+        cpu.registers.PC = cpu_address_mode(pc + i, cpu.ADL);
+        debug_inst_fetch();
+    }
+    cpu.registers.PC = pc;
+#endif
+    for (i = 1; i < d->length; i++) {
+        uint32_t address = cpu_address_mode(cpu.registers.PC + i, cpu.ADL);
+        mem_fetch_track(address, d->bytes[i]);
+        trace_access(TRACE_MEM_FETCH, address, d->bytes[i]);
+    }
+}
+
+/* Handlers are written once with the mode as a parameter and instantiated for ADL and Z80 mode by
+ * CPU_OP_MODES(), the decoder picks the variant matching the ADL bit of the cache tag.  Decoded
+ * instructions are never suffixed, so L, IL and ADL all equal that mode while they run. */
+#define CPU_OP_MODES(name) \
+    static void name##_adl(const cpu_decoded_t *d) { name(d, true); } \
+    static void name##_z80(const cpu_decoded_t *d) { name(d, false); }
+#define CPU_OP(name) (adl ? name##_adl : name##_z80)
+
+/* Prefetch the instruction that follows */
+static inline void cpu_decode_next(const cpu_decoded_t *d, bool adl) {
+    cpu_prefetch(cpu.registers.PC + d->length, adl);
+}
+
+/* Step over the instruction without prefetching, like cpu_fetch_word_no_prefetch */
+static inline void cpu_decode_skip(const cpu_decoded_t *d, bool adl) {
+    cpu.registers.PC = cpu_address_mode(cpu.registers.PC + d->length, adl);
+}
+
+static inline void cpu_decode_jr(const cpu_decoded_t *d, bool adl) {
+    cpu_prefetch(cpu_mask_mode((int32_t)cpu.registers.PC + (int8_t)d->imm, adl), adl);
+}
+
+/* (HL) or (IX/IY + d) without fetching the offset, the offset is the low byte of the immediate */
+static inline uint32_t cpu_decode_address(const cpu_decoded_t *d, bool adl) {
+    int32_t value = cpu_read_index();
+    if (cpu.PREFIX) {
+        value += (int8_t)d->imm;
+    }
+    return cpu_mask_mode(value, adl);
+}
+
+static inline void cpu_op_nop(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+}
+static inline void cpu_op_ex_af(const cpu_decoded_t *d, bool adl) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t w;
+    cpu_decode_next(d, adl);
+    w = r->AF;
+    r->AF = r->_AF;
+    r->_AF = w;
+}
+static inline void cpu_op_djnz(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    if (--cpu.registers.B) {
+        cpu.cycles++;
+        cpu_decode_jr(d, adl);
+    }
+}
+static inline void cpu_op_jr(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_decode_jr(d, adl);
+}
+static inline void cpu_op_jr_cc(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    if (cpu_read_cc(d->context.y - 4)) {
+        cpu.cycles++;
+        cpu_decode_jr(d, adl);
+    }
+}
+static inline void cpu_op_ld_rp_imm(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_rp(d->context.p, d->imm);
+}
+static inline void cpu_op_add_hl_rp(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_add_index(d->context.p);
+}
+static inline void cpu_op_ld_ind_a(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_byte_mode(d->context.p ? cpu.registers.DE : cpu.registers.BC, cpu.registers.A, adl);
+}
+static inline void cpu_op_ld_a_ind(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.registers.A = cpu_read_byte_mode(d->context.p ? cpu.registers.DE : cpu.registers.BC, adl);
+}
+static inline void cpu_op_ld_mem_hl(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_word_mode(d->imm, cpu_read_index(), adl);
+}
+static inline void cpu_op_ld_hl_mem(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_index(cpu_read_word_mode(d->imm, adl));
+}
+static inline void cpu_op_ld_mem_a(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_byte_mode(d->imm, cpu.registers.A, adl);
+}
+static inline void cpu_op_ld_a_mem(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.registers.A = cpu_read_byte_mode(d->imm, adl);
+}
+static inline void cpu_op_inc_rp(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_rp(d->context.p, (int32_t)cpu_read_rp(d->context.p) + 1);
+}
+static inline void cpu_op_dec_rp(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_rp(d->context.p, (int32_t)cpu_read_rp(d->context.p) - 1);
+}
+static inline void cpu_op_inc_r(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_inc(d->context.y, (d->context.y == 6) ? cpu_decode_address(d, adl) : 0);
+}
+static inline void cpu_op_dec_r(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_dec(d->context.y, (d->context.y == 6) ? cpu_decode_address(d, adl) : 0);
+}
+static inline void cpu_op_ld_r_imm(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = 0, value = d->imm;
+    if (d->context.y == 6) {
+        address = cpu_decode_address(d, adl);
+        if (cpu.PREFIX) {
+            value >>= 8;
+        }
+    }
+    cpu_decode_next(d, adl);
+    cpu_write_reg_prefetched(d->context.y, address, value);
+}
+static inline void cpu_op_rot_acc(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_rot_acc(d->context.y);
+}
+static inline void cpu_op_ld_r_r(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_read_write_reg(d->context.z, d->context.y);
+}
+static inline void cpu_op_alu_r(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    if (d->context.z == 6) {
+        cpu_execute_alu(d->context.y, cpu_read_byte_mode(cpu_decode_address(d, adl), adl));
+    } else {
+        cpu_execute_alu(d->context.y, cpu_read_reg(d->context.z));
+    }
+}
+static inline void cpu_op_alu_imm(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_alu(d->context.y, d->imm);
+}
+static inline void cpu_op_ret_cc(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.cycles++;
+    if (cpu_read_cc(d->context.y)) {
+        cpu_return_mode(adl);
+    }
+}
+static inline void cpu_op_pop(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_rp2(d->context.p, cpu_pop_word_mode(adl));
+}
+static inline void cpu_op_ret(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_return_mode(adl);
+}
+static inline void cpu_op_exx(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_exx();
+}
+static inline void cpu_op_jp_hl(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_prefetch_discard();
+    cpu_jump(cpu_read_index(), adl);
+}
+static inline void cpu_op_ld_sp_hl(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.registers.stack[adl].hl = cpu_read_index();
+}
+static inline void cpu_op_jp_cc(const cpu_decoded_t *d, bool adl) {
+    if (cpu_read_cc(d->context.y)) {
+        cpu.cycles++;
+        cpu_decode_skip(d, adl);
+        cpu_jump(d->imm, adl);
+    } else {
+        cpu_decode_next(d, adl);
+    }
+}
+static inline void cpu_op_jp(const cpu_decoded_t *d, bool adl) {
+    cpu.cycles++;
+    cpu_decode_skip(d, adl);
+    cpu_jump(d->imm, adl);
+}
+static inline void cpu_op_out_a(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_out((cpu.registers.A << 8) | d->imm, cpu.registers.A);
+}
+static inline void cpu_op_in_a(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.registers.A = cpu_read_in((cpu.registers.A << 8) | d->imm);
+}
+static inline void cpu_op_ex_sp_hl(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_ex_sp();
+}
+static inline void cpu_op_ex_de_hl(const cpu_decoded_t *d, bool adl) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t w;
+    cpu_decode_next(d, adl);
+    w = cpu_mask_mode(r->DE, adl);
+    r->DE = cpu_mask_mode(r->HL, adl);
+    r->HL = w;
+}
+static inline void cpu_op_di(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.IEF_wait = cpu.IEF1 = cpu.IEF2 = false;
+    cpu_restore_next();
+}
+static inline void cpu_op_ei(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.IEF_wait = true;
+    cpu.eiDelay = cpu.cycles + 1;
+    cpu_restore_next();
+}
+static inline void cpu_op_call_cc(const cpu_decoded_t *d, bool adl) {
+    if (cpu_read_cc(d->context.y)) {
+        cpu_decode_skip(d, adl);
+        cpu_call_mode(d->imm, adl);
+    } else {
+        cpu_decode_next(d, adl);
+    }
+}
+static inline void cpu_op_push(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_push_word_mode(cpu_read_rp2(d->context.p), adl);
+}
+static inline void cpu_op_call(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_skip(d, adl);
+    cpu_call_mode(d->imm, adl);
+}
+static inline void cpu_op_rst(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu.cycles++;
+    cpu_call_mode(d->context.y << 3, adl);
+}
+
+/* 0xED prefixed, d->context holds the second opcode */
+static inline void cpu_op_in0(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_in0(d->context.y, d->imm);
+}
+static inline void cpu_op_out0(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_out(d->imm, cpu_read_reg(d->context.y));
+}
+static inline void cpu_op_adc_sbc(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_execute_adc_sbc(d->context.q, d->context.p);
+}
+static inline void cpu_op_ld_mem_rp(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_word_mode(d->imm, cpu_read_rp(d->context.p), adl);
+}
+static inline void cpu_op_ld_rp_mem(const cpu_decoded_t *d, bool adl) {
+    cpu_decode_next(d, adl);
+    cpu_write_rp(d->context.p, cpu_read_word_mode(d->imm, adl));
+}
+static inline void cpu_op_lea(const cpu_decoded_t *d, bool adl) {
+    uint32_t address;
+    cpu.PREFIX = d->context.z;
+    address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    cpu_write_rp3(d->context.p, address);
+}
+
+/* 0xDD/0xFD prefixed forms that address memory through (IX/IY + d) */
+static inline void cpu_op_ld_r_ind(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    cpu.PREFIX = 0;
+    cpu_write_reg(d->context.y, cpu_read_byte_mode(address, adl));
+}
+static inline void cpu_op_ld_ind_r(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    cpu.PREFIX = 0;
+    cpu_write_byte_mode(address, cpu_read_reg(d->context.z), adl);
+}
+static inline void cpu_op_ld_rp3_ind(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    if (d->context.q) {
+        cpu_write_word_mode(address, cpu_read_rp3(d->context.p), adl);
+    } else {
+        cpu_write_rp3(d->context.p, cpu_read_word_mode(address, adl));
+    }
+}
+static inline void cpu_op_ld_other_index_ind(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    cpu_write_other_index(cpu_read_word_mode(address, adl));
+}
+static inline void cpu_op_ld_ind_other_index(const cpu_decoded_t *d, bool adl) {
+    uint32_t address = cpu_decode_address(d, adl);
+    cpu_decode_next(d, adl);
+    cpu_write_word_mode(address, cpu_read_other_index(), adl);
+}
+
+CPU_OP_MODES(cpu_op_nop)
+CPU_OP_MODES(cpu_op_ex_af)
+CPU_OP_MODES(cpu_op_djnz)
+CPU_OP_MODES(cpu_op_jr)
+CPU_OP_MODES(cpu_op_jr_cc)
+CPU_OP_MODES(cpu_op_ld_rp_imm)
+CPU_OP_MODES(cpu_op_add_hl_rp)
+CPU_OP_MODES(cpu_op_ld_ind_a)
+CPU_OP_MODES(cpu_op_ld_a_ind)
+CPU_OP_MODES(cpu_op_ld_mem_hl)
+CPU_OP_MODES(cpu_op_ld_hl_mem)
+CPU_OP_MODES(cpu_op_ld_mem_a)
+CPU_OP_MODES(cpu_op_ld_a_mem)
+CPU_OP_MODES(cpu_op_inc_rp)
+CPU_OP_MODES(cpu_op_dec_rp)
+CPU_OP_MODES(cpu_op_inc_r)
+CPU_OP_MODES(cpu_op_dec_r)
+CPU_OP_MODES(cpu_op_ld_r_imm)
+CPU_OP_MODES(cpu_op_rot_acc)
+CPU_OP_MODES(cpu_op_ld_r_r)
+CPU_OP_MODES(cpu_op_alu_r)
+CPU_OP_MODES(cpu_op_alu_imm)
+CPU_OP_MODES(cpu_op_ret_cc)
+CPU_OP_MODES(cpu_op_pop)
+CPU_OP_MODES(cpu_op_ret)
+CPU_OP_MODES(cpu_op_exx)
+CPU_OP_MODES(cpu_op_jp_hl)
+CPU_OP_MODES(cpu_op_ld_sp_hl)
+CPU_OP_MODES(cpu_op_jp_cc)
+CPU_OP_MODES(cpu_op_jp)
+CPU_OP_MODES(cpu_op_out_a)
+CPU_OP_MODES(cpu_op_in_a)
+CPU_OP_MODES(cpu_op_ex_sp_hl)
+CPU_OP_MODES(cpu_op_ex_de_hl)
+CPU_OP_MODES(cpu_op_di)
+CPU_OP_MODES(cpu_op_ei)
+CPU_OP_MODES(cpu_op_call_cc)
+CPU_OP_MODES(cpu_op_push)
+CPU_OP_MODES(cpu_op_call)
+CPU_OP_MODES(cpu_op_rst)
+CPU_OP_MODES(cpu_op_in0)
+CPU_OP_MODES(cpu_op_out0)
+CPU_OP_MODES(cpu_op_adc_sbc)
+CPU_OP_MODES(cpu_op_ld_mem_rp)
+CPU_OP_MODES(cpu_op_ld_rp_mem)
+CPU_OP_MODES(cpu_op_lea)
+CPU_OP_MODES(cpu_op_ld_r_ind)
+CPU_OP_MODES(cpu_op_ld_ind_r)
+CPU_OP_MODES(cpu_op_ld_rp3_ind)
+CPU_OP_MODES(cpu_op_ld_other_index_ind)
+CPU_OP_MODES(cpu_op_ld_ind_other_index)
+
+typedef void (*cpu_decode_handler_t)(const cpu_decoded_t *);
+
+/* Unprefixed opcodes, suffixes, HALT and prefixes are left to the interpreter */
+static cpu_decode_handler_t cpu_decode_main(eZ80context_t context, bool adl, uint8_t *length, uint8_t *flags) {
+    const uint8_t word = adl ? 3 : 2;
+    switch (context.x) {
+        case 0:
+            switch (context.z) {
+                case 0:
+                    if (context.y >= 2) {
+                        *flags = CPU_DECODE_BRANCH;
+                        *length = 2;
+                    }
+                    switch (context.y) {
+                        case 0: return CPU_OP(cpu_op_nop);
+                        case 1: *flags = CPU_DECODE_FLAGS; return CPU_OP(cpu_op_ex_af);
+                        case 2: return CPU_OP(cpu_op_djnz);
+                        case 3: return CPU_OP(cpu_op_jr);
+                        default: return CPU_OP(cpu_op_jr_cc);
+                    }
+                case 1:
+                    if (context.q) {
+                        *flags = CPU_DECODE_FLAGS;
+                        return CPU_OP(cpu_op_add_hl_rp);
+                    }
+                    *length += word;
+                    return CPU_OP(cpu_op_ld_rp_imm);
+                case 2:
+                    if (context.p < 2) {
+                        return context.q ? CPU_OP(cpu_op_ld_a_ind) : CPU_OP(cpu_op_ld_ind_a);
+                    }
+                    *length += word;
+                    if (context.p == 2) {
+                        return context.q ? CPU_OP(cpu_op_ld_hl_mem) : CPU_OP(cpu_op_ld_mem_hl);
+                    }
+                    return context.q ? CPU_OP(cpu_op_ld_a_mem) : CPU_OP(cpu_op_ld_mem_a);
+                case 3: return context.q ? CPU_OP(cpu_op_dec_rp) : CPU_OP(cpu_op_inc_rp);
+                case 4: return CPU_OP(cpu_op_inc_r);
+                case 5: return CPU_OP(cpu_op_dec_r);
+                case 6: *length = 2; return CPU_OP(cpu_op_ld_r_imm);
+                case 7: *flags = CPU_DECODE_FLAGS; return CPU_OP(cpu_op_rot_acc);
+            }
+            break;
+        case 1:
+            if (context.z != context.y) {
+                return CPU_OP(cpu_op_ld_r_r);
+            }
+            break;
+        case 2:
+            return CPU_OP(cpu_op_alu_r);
+        case 3:
+            switch (context.z) {
+                case 0: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_ret_cc);
+                case 1:
+                    if (!context.q) {
+                        *flags = (context.p == 3) ? CPU_DECODE_FLAGS : 0;
+                        return CPU_OP(cpu_op_pop);
+                    }
+                    switch (context.p) {
+                        case 0: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_ret);
+                        case 1: return CPU_OP(cpu_op_exx);
+                        case 2: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_jp_hl);
+                        case 3: return CPU_OP(cpu_op_ld_sp_hl);
+                    }
+                    break;
+                case 2: *length += word; *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_jp_cc);
+                case 3:
+                    switch (context.y) {
+                        case 0: *length += word; *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_jp);
+                        case 1: break; /* 0xCB prefix */
+                        case 2: *length = 2; return CPU_OP(cpu_op_out_a);
+                        case 3: *length = 2; return CPU_OP(cpu_op_in_a);
+                        case 4: return CPU_OP(cpu_op_ex_sp_hl);
+                        case 5: return CPU_OP(cpu_op_ex_de_hl);
+                        case 6: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_di);
+                        case 7: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_ei);
+                    }
+                    break;
+                case 4: *length += word; *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_call_cc);
+                case 5:
+                    if (!context.q) {
+                        *flags = (context.p == 3) ? CPU_DECODE_FLAGS : 0;
+                        return CPU_OP(cpu_op_push);
+                    }
+                    if (context.p == 0) {
+                        *length += word;
+                        *flags = CPU_DECODE_BRANCH;
+                        return CPU_OP(cpu_op_call);
+                    }
+                    break;
+                case 6: *length = 2; return CPU_OP(cpu_op_alu_imm);
+                case 7: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_rst);
+            }
+            break;
+    }
+    return NULL;
+}
+
+/* Second byte of 0xED prefixed opcodes, length starts at 2 */
+static cpu_decode_handler_t cpu_decode_ed(eZ80context_t context, bool adl, uint8_t *length, uint8_t *flags) {
+    const uint8_t word = adl ? 3 : 2;
+    switch (context.x) {
+        case 0:
+            switch (context.z) {
+                case 0: *length = 3; *flags = CPU_DECODE_FLAGS; return CPU_OP(cpu_op_in0);
+                case 1:
+                    if (context.y != 6) {
+                        *length = 3;
+                        return CPU_OP(cpu_op_out0);
+                    }
+                    break;
+                case 2:
+                case 3:
+                    if (!context.q) {
+                        *length = 3;
+                        return CPU_OP(cpu_op_lea);
+                    }
+                    break;
+            }
+            break;
+        case 1:
+            switch (context.z) {
+                case 2: *flags = CPU_DECODE_FLAGS; return CPU_OP(cpu_op_adc_sbc);
+                case 3: *length += word; return context.q ? CPU_OP(cpu_op_ld_rp_mem) : CPU_OP(cpu_op_ld_mem_rp);
+            }
+            break;
+    }
+    return NULL;
+}
+
+/* Second byte of 0xDD/0xFD prefixed opcodes, length starts at 2, only forms the interpreter doesn't trap */
+static cpu_decode_handler_t cpu_decode_index(eZ80context_t context, bool adl, uint8_t *length, uint8_t *flags) {
+    const uint8_t word = adl ? 3 : 2;
+    switch (context.x) {
+        case 0:
+            switch (context.z) {
+                case 1:
+                    if (context.q) {
+                        *flags = CPU_DECODE_FLAGS;
+                        return CPU_OP(cpu_op_add_hl_rp);
+                    }
+                    if (context.p == 2) {
+                        *length += word;
+                        return CPU_OP(cpu_op_ld_rp_imm);
+                    }
+                    if (context.y == 6) {
+                        *length = 3;
+                        return CPU_OP(cpu_op_ld_other_index_ind);
+                    }
+                    break;
+                case 2:
+                    if (context.p == 2) {
+                        *length += word;
+                        return context.q ? CPU_OP(cpu_op_ld_hl_mem) : CPU_OP(cpu_op_ld_mem_hl);
+                    }
+                    break;
+                case 3:
+                    if (context.p == 2) {
+                        return context.q ? CPU_OP(cpu_op_dec_rp) : CPU_OP(cpu_op_inc_rp);
+                    }
+                    break;
+                case 4:
+                case 5:
+                    if (context.y >= 4 && context.y <= 6) {
+                        *length += context.y == 6;
+                        return context.z == 4 ? CPU_OP(cpu_op_inc_r) : CPU_OP(cpu_op_dec_r);
+                    }
+                    break;
+                case 6:
+                    if (context.y == 4 || context.y == 5) {
+                        *length = 3;
+                        return CPU_OP(cpu_op_ld_r_imm);
+                    }
+                    if (context.y == 6) {
+                        *length = 4;
+                        return CPU_OP(cpu_op_ld_r_imm);
+                    }
+                    if (context.y == 7) {
+                        *length = 3;
+                        return CPU_OP(cpu_op_ld_ind_other_index);
+                    }
+                    break;
+                case 7:
+                    *length = 3;
+                    return CPU_OP(cpu_op_ld_rp3_ind);
+            }
+            break;
+        case 1:
+            if (context.z == context.y ||
+                ((context.z < 4 || context.z == 7) && (context.y < 4 || context.y == 7))) {
+                break;
+            }
+            if (context.z == 6) {
+                *length = 3;
+                return CPU_OP(cpu_op_ld_r_ind);
+            }
+            if (context.y == 6) {
+                *length = 3;
+                return CPU_OP(cpu_op_ld_ind_r);
+            }
+            return CPU_OP(cpu_op_ld_r_r);
+        case 2:
+            if (context.z == 4 || context.z == 5) {
+                return CPU_OP(cpu_op_alu_r);
+            }
+            if (context.z == 6) {
+                *length = 3;
+                return CPU_OP(cpu_op_alu_r);
+            }
+            break;
+        case 3:
+            switch (context.opcode) {
+                case 0xE1: return CPU_OP(cpu_op_pop);
+                case 0xE3: return CPU_OP(cpu_op_ex_sp_hl);
+                case 0xE5: return CPU_OP(cpu_op_push);
+                case 0xE9: *flags = CPU_DECODE_BRANCH; return CPU_OP(cpu_op_jp_hl);
+                case 0xF9: return CPU_OP(cpu_op_ld_sp_hl);
+            }
+            break;
+    }
+    return NULL;
+}
+
+/* Decode the instruction at pc into entry, returns false if it wasn't cacheable */
+static bool cpu_decode_entry(cpu_decoded_t *entry, uint32_t pc, uint8_t opcode, bool adl) {
+    cpu_decode_handler_t handler = NULL;
+    uint8_t length = 1, operand = 1, flags = 0, prefix = 0;
+    const uint8_t *code;
+    eZ80context_t context;
+
+    context.opcode = opcode;
+    if (opcode == 0xDD || opcode == 0xED || opcode == 0xFD) {
+        if ((code = mem_fetch_ptr(pc, 2))) {
+            context.opcode = code[1];
+            operand = length = 2;
+            if (opcode == 0xED) {
+                handler = cpu_decode_ed(context, adl, &length, &flags);
+            } else {
+                prefix = (opcode == 0xDD) ? 2 : 3;
+                handler = cpu_decode_index(context, adl, &length, &flags);
+            }
+        }
+    } else {
+        handler = cpu_decode_main(context, adl, &length, &flags);
+    }
+
+    entry->tag = pc | (uint32_t)adl << 24;
+    entry->context = context;
+    entry->bytes[0] = opcode;
+    entry->length = 1;
+    entry->flags = flags;
+    entry->prefix = prefix;
+    entry->refresh = operand * 2;
+    entry->handler = NULL;
+
+    /* operands must come from plain memory and must not wrap around a 64k segment */
+    code = mem_fetch_ptr(pc, length);
+    if (!handler || !code || (!adl && (pc & 0xFFFF) + length > 0x10000)) {
+        return false;
+    }
+
+    memcpy(&entry->bytes[1], &code[1], length - 1);
+    code += operand;
+    switch (length - operand) {
+        case 1: entry->imm = code[0]; break;
+        case 2: entry->imm = code[0] | code[1] << 8; break;
+        case 3: entry->imm = code[0] | code[1] << 8 | code[2] << 16; break;
+        default: entry->imm = 0; break;
+    }
+    entry->length = length;
+    entry->handler = handler;
+    cpu_decode_mark(pc);
+    cpu_decode_mark(pc + length - 1);
+    return true;
+}
+
+static uint64_t cpu_retired;                     /* instructions completed since startup */
+
+uint64_t cpu_instructions(void) {
+    return cpu_retired;
+}
+
+#ifdef CPU_STATS
+/* Instrumentation build: executions and cycles per (prefix, opcode) and mode, see cpu_stats_save() */
+enum cpu_stats_prefix {
+    CPU_STATS_NONE, CPU_STATS_CB, CPU_STATS_ED, CPU_STATS_DD, CPU_STATS_FD,
+    CPU_STATS_DDCB, CPU_STATS_FDCB, CPU_STATS_PREFIXES
+};
+
+static const char *const cpu_stats_prefix_names[CPU_STATS_PREFIXES] = {
+    "-", "CB", "ED", "DD", "FD", "DDCB", "FDCB"
+};
+
+static struct {
+    struct {
+        uint64_t count;
+        uint64_t cycles;
+    } entry[2][CPU_STATS_PREFIXES][0x100];
+    uint64_t start;                              /* sched_total_cycles() when the instruction started */
+    uint8_t prefix, opcode;
+    bool adl;
+} cpu_stats;
+
+static uint8_t cpu_stats_byte(uint32_t pc, uint32_t offset) {
+    return mem_peek_byte(cpu_address_mode(pc + offset, cpu.ADL));
+}
+
+/* Classify the instruction at PC, suffixes are counted with the instruction they modify */
+static void cpu_stats_begin(void) {
+    uint32_t pc = cpu.registers.PC, i = 0;
+    uint8_t opcode = cpu_stats_byte(pc, i);
+    uint8_t prefix = CPU_STATS_NONE;
+
+    while (i < 3 && (opcode == 0x40 || opcode == 0x49 || opcode == 0x52 || opcode == 0x5B)) {
+        opcode = cpu_stats_byte(pc, ++i);
+    }
+    if (opcode == 0xCB) {
+        prefix = CPU_STATS_CB;
+        opcode = cpu_stats_byte(pc, ++i);
+    } else if (opcode == 0xED) {
+        prefix = CPU_STATS_ED;
+        opcode = cpu_stats_byte(pc, ++i);
+    } else if (opcode == 0xDD || opcode == 0xFD) {
+        prefix = opcode == 0xDD ? CPU_STATS_DD : CPU_STATS_FD;
+        opcode = cpu_stats_byte(pc, ++i);
+        if (opcode == 0xCB) {
+            prefix = prefix == CPU_STATS_DD ? CPU_STATS_DDCB : CPU_STATS_FDCB;
+            opcode = cpu_stats_byte(pc, i + 2); /* skip the displacement */
+        }
+    }
+    cpu_stats.prefix = prefix;
+    cpu_stats.opcode = opcode;
+    cpu_stats.adl = cpu.ADL;
+    cpu_stats.start = sched_total_cycles();
+}
+
+static void cpu_stats_end(void) {
+    cpu_stats.entry[cpu_stats.adl][cpu_stats.prefix][cpu_stats.opcode].count++;
+    cpu_stats.entry[cpu_stats.adl][cpu_stats.prefix][cpu_stats.opcode].cycles += sched_total_cycles() - cpu_stats.start;
+}
+
+void cpu_stats_reset(void) {
+    memset(&cpu_stats, 0, sizeof(cpu_stats));
+}
+
+bool cpu_stats_save(FILE *file) {
+    static const char *const modes[2] = { "z80", "adl" };
+    unsigned int mode, prefix, opcode;
+    bool ret = fprintf(file, "mode,prefix,opcode,count,cycles\n") > 0;
+
+    for (mode = 0; mode < 2; mode++) {
+        uint64_t count = 0, cycles = 0;
+        for (prefix = 0; prefix < CPU_STATS_PREFIXES; prefix++) {
+            for (opcode = 0; opcode < 0x100; opcode++) {
+                if (cpu_stats.entry[mode][prefix][opcode].count) {
+                    count += cpu_stats.entry[mode][prefix][opcode].count;
+                    cycles += cpu_stats.entry[mode][prefix][opcode].cycles;
+                    ret &= fprintf(file, "%s,%s,%02X,%llu,%llu\n", modes[mode], cpu_stats_prefix_names[prefix], opcode,
+                                   (unsigned long long)cpu_stats.entry[mode][prefix][opcode].count,
+                                   (unsigned long long)cpu_stats.entry[mode][prefix][opcode].cycles) > 0;
+                }
+            }
+        }
+        ret &= fprintf(file, "%s,total,,%llu,%llu\n", modes[mode], (unsigned long long)count, (unsigned long long)cycles) > 0;
+    }
+    return ret;
+}
+#else
+#define cpu_stats_begin() do { } while (0)
+#define cpu_stats_end() do { } while (0)
+#endif
+
+static void cpu_decode_execute(const cpu_decoded_t *d) {
+    cpu_stats_begin();
+    if (d->flags & CPU_DECODE_FLAGS) {
+        cpu_flags_materialize();
+    }
+    cpu.registers.R += d->refresh;
+    cpu.PREFIX = d->prefix;
+    cpu_decode_fetch(d);
+    d->handler(d);
+    cpu_inst_start();
+    cpu.cycles++; /* COCOACRUMBS */
+    cpu_retired++;
+    cpu_stats_end();
+}
+
+static const cpu_decoded_t *cpu_decode_lookup(void) {
+    uint32_t pc = cpu.registers.PC;
+    cpu_decoded_t *entry = &cpu_decode.entry[pc & CPU_DECODE_MASK];
+    if (unlikely(entry->tag != (pc | (uint32_t)cpu.ADL << 24) || entry->bytes[0] != cpu.prefetch)) {
+        if (!cpu_decode_entry(entry, pc, cpu.prefetch, cpu.ADL)) {
+            return NULL;
+        }
+    }
+    return entry->handler ? entry : NULL;
+}
+
+/* Decode the straight-line run at pc into block, returns false if nothing there could be decoded */
+static bool cpu_block_build(cpu_block_t *block, uint32_t pc, bool adl) {
+    uint32_t start = pc;
+    const uint8_t *code;
+    uint8_t count = 0;
+
+    block->tag = CPU_DECODE_EMPTY;
+    block->link = NULL;
+    while (count < CPU_BLOCK_OPS) {
+        cpu_decoded_t *op = &block->ops[count];
+        if (!(code = mem_fetch_ptr(pc, 1)) || !cpu_decode_entry(op, pc, *code, adl) ||
+            pc + op->length - start > CPU_BLOCK_SPAN) {
+            break;
+        }
+        count++;
+        pc += op->length;
+        if ((op->flags & CPU_DECODE_BRANCH) || (!adl && !(pc & 0xFFFF))) {
+            break;
+        }
+    }
+    if (!count) {
+        return false;
+    }
+    block->tag = start | (uint32_t)adl << 24;
+    block->count = count;
+    block->span = pc - start;
+    return true;
+}
+
+static cpu_block_t *cpu_block_lookup(void) {
+    uint32_t key = cpu.registers.PC | (uint32_t)cpu.ADL << 24;
+    cpu_block_t *block = &cpu_decode.block[cpu.registers.PC & CPU_BLOCK_MASK];
+    if (likely(block->tag == key && block->ops[0].bytes[0] == cpu.prefetch)) {
+        return block;
+    }
+    if (block->candidate != key) {
+        block->candidate = key;
+        block->heat = 0;
+    }
+    if (++block->heat < CPU_BLOCK_HOT) {
+        return NULL;
+    }
+    block->heat = 0;
+    /* the block is decoded from memory, which may no longer hold the prefetched opcode */
+    return cpu_block_build(block, cpu.registers.PC, cpu.ADL) && block->ops[0].bytes[0] == cpu.prefetch ? block : NULL;
+}
+
+/* Run blocks back to back until one is left early or the cycle budget is used up */
+static void cpu_block_execute(cpu_block_t *block) {
+    eZ80registers_t *r = &cpu.registers;
+    cpu_block_t *next;
+    uint32_t key;
+
+    while (true) {
+        const cpu_decoded_t *d = block->ops, *end = d + block->count;
+        uint32_t tag = block->tag;
+        while (true) {
+            cpu_decode_execute(d);
+            if (++d == end) {
+                break;
+            }
+            /* stop on events, self modifying code, or if an instruction left the expected path */
+            if (cpu.cycles >= cpu.next || cpu.abort != CPU_ABORT_NONE || block->tag != tag ||
+                (r->PC | (uint32_t)cpu.ADL << 24) != d->tag) {
+                return;
+            }
+        }
+        if (cpu.cycles >= cpu.next || cpu.abort != CPU_ABORT_NONE) {
+            return;
+        }
+        key = r->PC | (uint32_t)cpu.ADL << 24;
+        next = block->link;
+        if (!next || next->tag != key) {
+            next = &cpu_decode.block[r->PC & CPU_BLOCK_MASK];
+            if (next->tag != key) {
+                return;
+            }
+            block->link = next;
+        }
+        if (next->ops[0].bytes[0] != cpu.prefetch) {
+            return;
+        }
+        block = next;
+    }
+}
+
 void cpu_init(void) {
     memset(&cpu, 0, sizeof(eZ80cpu_t));
+    cpu_flags.op = CPU_FLAGS_VALID;
     cpu.abort = CPU_ABORT_NONE;
+    cpu_decode_flush();
     printf("[eZ80-Emu] Initialized CPU...\n");
 }
 
@@ -766,6 +2070,8 @@ void cpu_reset(void) {
     bool preI = cpu.preI;
     memset(&cpu, 0, sizeof(cpu));
     cpu.preI = preI;
+    cpu_flags.op = CPU_FLAGS_VALID;
+    cpu_decode_flush();
     cpu_restore_next();
     cpu_flush(0, false);
     printf("[eZ80-Emu] CPU reset.\n");
@@ -830,7 +2136,6 @@ void cpu_restore_next(void) {
 void cpu_execute(void) {
     /* variable declarations */
     int8_t s;
-    int32_t sw;
     uint32_t w = 0;
 
     uint8_t old = 0;
@@ -839,10 +2144,10 @@ void cpu_execute(void) {
     uint8_t new = 0;
     uint32_t new_word;
 
-    uint32_t op_word;
-
     eZ80registers_t *r = &cpu.registers;
     eZ80context_t context;
+    const cpu_decoded_t *decoded;
+    cpu_block_t *block;
 
     while (true) {
     cpu_execute_continue:
@@ -851,6 +2156,7 @@ void cpu_execute(void) {
             cpu.IEF1 = cpu.IEF2 = true;
         }
         if (cpu.NMI || (cpu.IEF1 && (intrpt->status & intrpt->enabled))) {
+            cpu_flags_materialize();
             cpu_prefetch_discard();
             cpu.cycles += 2;
             cpu.L = cpu.IL = cpu.ADL || cpu.MADL;
@@ -859,9 +2165,15 @@ void cpu_execute(void) {
                 cpu.NMI = false;
                 cpu_call(0x66, cpu.MADL);
             } else {
+                uint8_t vector;
                 cpu.IEF2 = false;
                 if (cpu.IM == 2) {
                     cpu_call(0x38, cpu.MADL);
+                } else if (cpu.IM == 3 && (vector = intrpt_vector())) {
+                    /* IM 2 with an on-chip source: a 16-bit handler address from the table at {I, vector} */
+                    uint32_t table = (uint32_t)r->I << 8 | vector;
+                    cpu.cycles++;
+                    cpu_call(cpu_read_byte_mode(table, cpu.MADL) | cpu_read_byte_mode(table + 1, cpu.MADL) << 8, cpu.MADL);
                 } else {
                     if (cpu.preI && cpu.IM == 3) {
                         cpu.cycles++;
@@ -879,12 +2191,25 @@ void cpu_execute(void) {
             cpu_restore_next();
         }
         if (cpu.cycles >= cpu.next || cpu.abort != CPU_ABORT_NONE) {
+            cpu_flags_materialize();
             break;
         }
         if (cpu.inBlock) {
             goto cpu_execute_bli_continue;
         }
         do {
+            if (!cpu.PREFIX && !cpu.SUFFIX) {
+                if ((block = cpu_block_lookup())) {
+                    cpu_block_execute(block);
+                    continue;
+                }
+                if ((decoded = cpu_decode_lookup())) {
+                    cpu_decode_execute(decoded);
+                    continue;
+                }
+                cpu_stats_begin();
+            }
+            cpu_flags_materialize();
             /* fetch opcode */
             context.opcode = cpu_fetch_byte();
             r->R += 2;
@@ -941,14 +2266,7 @@ void cpu_execute(void) {
                                     cpu_write_rp(context.p, cpu_fetch_word());
                                     break;
                                 case 1: /* ADD HL,rr */
-                                    old_word = cpu_mask_mode(cpu_read_index(), cpu.L);
-                                    op_word = cpu_mask_mode(cpu_read_rp(context.p), cpu.L);
-                                    new_word = old_word + op_word;
-                                    cpu_write_index(cpu_mask_mode(new_word, cpu.L));
-                                    r->F = cpuflag_s(r->flags.S) | cpuflag_zero(!r->flags.Z)
-                                        | cpuflag_undef(r->F) | cpuflag_pv(r->flags.PV)
-                                        | cpuflag_subtract(0) | cpuflag_carry_w(new_word, cpu.L)
-                                        | cpuflag_halfcarry_w_add(old_word, op_word, 0);
+                                    cpu_execute_add_index(context.p);
                                     break;
                             }
                             break;
@@ -1011,26 +2329,14 @@ void cpu_execute(void) {
                                 cpu_trap();
                                 break;
                             }
-                            w = (context.y == 6) ? cpu_index_address() : 0;
-                            old = cpu_read_reg_prefetched(context.y, w);
-                            new = old + 1;
-                            cpu_write_reg_prefetched(context.y, w, new);
-                            r->F = cpuflag_c(r->flags.C) | cpuflag_sign_b(new) | cpuflag_zero(new)
-                                | cpuflag_halfcarry_b_add(old, 0, 1) | cpuflag_pv(new == 0x80)
-                                | cpuflag_subtract(0) | cpuflag_undef(r->F);
+                            cpu_execute_inc(context.y, (context.y == 6) ? cpu_index_address() : 0);
                             break;
                         case 5: /* DEC r[y] */
                             if (cpu.PREFIX && (context.y < 4 || context.y == 7)) {
                                 cpu_trap();
                                 break;
                             }
-                            w = (context.y == 6) ? cpu_index_address() : 0;
-                            old = cpu_read_reg_prefetched(context.y, w);
-                            new = old - 1;
-                            cpu_write_reg_prefetched(context.y, w, new);
-                            r->F = cpuflag_c(r->flags.C) | cpuflag_sign_b(new) | cpuflag_zero(new)
-                                | cpuflag_halfcarry_b_sub(old, 0, 1) | cpuflag_pv(old == 0x80)
-                                | cpuflag_subtract(1) | cpuflag_undef(r->F);
+                            cpu_execute_dec(context.y, (context.y == 6) ? cpu_index_address() : 0);
                             break;
                         case 6: /* LD r[y], n */
                             if (cpu.PREFIX) {
@@ -1127,15 +2433,7 @@ void cpu_execute(void) {
                                             cpu_return();
                                             break;
                                         case 1: /* EXX */
-                                            w = r->BC;
-                                            r->BC = r->_BC;
-                                            r->_BC = w;
-                                            w = r->DE;
-                                            r->DE = r->_DE;
-                                            r->_DE = w;
-                                            w = r->HL;
-                                            r->HL = r->_HL;
-                                            r->_HL = w;
+                                            cpu_execute_exx();
                                             break;
                                         case 2: /* JP (rr) */
                                             cpu_prefetch_discard();
@@ -1204,11 +2502,7 @@ void cpu_execute(void) {
                                     r->A = cpu_read_in((r->A << 8) | cpu_fetch_byte());
                                     break;
                                 case 4: /* EX (SP), HL/I */
-                                    w = cpu_read_sp();
-                                    old_word = cpu_read_word(w);
-                                    new_word = cpu_read_index();
-                                    cpu_write_index(old_word);
-                                    cpu_write_word(w, new_word);
+                                    cpu_execute_ex_sp();
                                     break;
                                 case 5: /* EX DE, HL */
                                     w = cpu_mask_mode(r->DE, cpu.L);
@@ -1262,13 +2556,7 @@ void cpu_execute(void) {
                                                 case 0:
                                                     switch (context.z) {
                                                         case 0: /* IN0 r[y], (n) */
-                                                            new = cpu_read_in(cpu_fetch_byte());
-                                                            if (context.y != 6) {
-                                                                cpu_write_reg(context.y, new);
-                                                            }
-                                                            r->F = cpuflag_sign_b(new) | cpuflag_zero(new)
-                                                                | cpuflag_undef(r->F) | cpuflag_parity(new)
-                                                                | cpuflag_c(r->flags.C);
+                                                            cpu_execute_in0(context.y, cpu_fetch_byte());
                                                             break;
                                                          case 1:
                                                             if (context.y == 6) { /* LD IY, (HL) */
@@ -1329,22 +2617,8 @@ void cpu_execute(void) {
                                                             }
                                                             cpu_write_out(r->BC, cpu_read_reg(context.y));
                                                             break;
-                                                        case 2:
-                                                            old_word = cpu_mask_mode(r->HL, cpu.L);
-                                                            op_word = cpu_mask_mode(cpu_read_rp(context.p), cpu.L);
-                                                            if (context.q == 0) { /* SBC HL, rp[p] */
-                                                                r->HL = cpu_mask_mode(sw = (int32_t)old_word - (int32_t)op_word - r->flags.C, cpu.L);
-                                                                r->F = cpuflag_sign_w(r->HL, cpu.L) | cpuflag_zero(r->HL)
-                                                                    | cpuflag_undef(r->F) | cpuflag_overflow_w_sub(old_word, op_word, r->HL, cpu.L)
-                                                                    | cpuflag_subtract(1) | cpuflag_carry_w(sw, cpu.L)
-                                                                    | cpuflag_halfcarry_w_sub(old_word, op_word, r->flags.C);
-                                                            } else { /* ADC HL, rp[p] */
-                                                                r->HL = cpu_mask_mode(sw = (int32_t)old_word + (int32_t)op_word + r->flags.C, cpu.L);
-                                                                r->F = cpuflag_sign_w(sw, cpu.L) | cpuflag_zero(r->HL)
-                                                                    | cpuflag_undef(r->F) | cpuflag_overflow_w_add(old_word, op_word, r->HL, cpu.L)
-                                                                    | cpuflag_subtract(0) | cpuflag_carry_w(sw, cpu.L)
-                                                                    | cpuflag_halfcarry_w_add(old_word, op_word, r->flags.C);
-                                                            }
+                                                        case 2: /* SBC/ADC HL, rp[p] */
+                                                            cpu_execute_adc_sbc(context.q, context.p);
                                                             break;
                                                         case 3:
                                                             if (context.q == 0) { /* LD (nn), rp[p] */
@@ -1555,11 +2829,15 @@ void cpu_execute(void) {
             }
             cpu_inst_start();
             cpu.cycles++; /* COCOACRUMBS */
+            cpu_retired++;
+            cpu_stats_end();
         } while (cpu.PREFIX || cpu.SUFFIX || cpu.cycles < cpu.next);
     }
 }
 
 bool cpu_restore(FILE *image) {
+    cpu_flags.op = CPU_FLAGS_VALID;
+    cpu_decode_flush();
     return fread(&cpu, sizeof(cpu), 1, image) == 1;
 }
 
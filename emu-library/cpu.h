@@ -97,8 +97,17 @@ void cpu_execute(void);
 void cpu_restore_next(void);
 void cpu_transition_abort(uint8_t from, uint8_t to);
 void cpu_crash(const char *msg);
+void cpu_decode_flush(void);
+void cpu_decode_invalidate(uint32_t address);
+void cpu_decode_invalidate_range(uint32_t address, uint32_t size);
 bool cpu_restore(FILE *image);
 bool cpu_save(FILE *image);
+uint64_t cpu_instructions(void);             /* instructions executed since startup */
+
+#ifdef CPU_STATS
+void cpu_stats_reset(void);                  /* clear the per-opcode counters */
+bool cpu_stats_save(FILE *file);             /* write the per-opcode counters as CSV */
+#endif
 
 #ifdef __cplusplus
 }
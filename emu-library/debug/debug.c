@@ -15,17 +15,23 @@ void debug_init(void) {
     debug_clear_step();
     debug.stackIndex = debug.stackSize = 0;
     debug.stack = (debug_stack_entry_t*)calloc(DBG_STACK_SIZE, sizeof(debug_stack_entry_t));
-    debug.addr = (uint8_t*)calloc(DBG_ADDR_SIZE, sizeof(uint8_t));
-    debug.port = (uint8_t*)calloc(DBG_PORT_SIZE, sizeof(uint8_t));
     debug.bufPos = debug.bufErrPos = 0;
     debug.open = false;
     printf("[eZ80-Emu] Initialized Debugger...\n");
 }
 
 void debug_free(void) {
+    unsigned int i;
     free(debug.stack);
-    free(debug.addr);
-    free(debug.port);
+    for (i = 0; i < DBG_ADDR_PAGES; i++) {
+        free(debug.addr[i]);
+        debug.addr[i] = NULL;
+    }
+    for (i = 0; i < DBG_PORT_PAGES; i++) {
+        free(debug.port[i]);
+        debug.port[i] = NULL;
+    }
+    debug.watchRead = debug.watchWrite = debug.watchExec = debug.watchPort = 0;
     printf("[eZ80-Emu] Freed Debugger.\n");
 }
 
@@ -59,22 +65,51 @@ void debug_open(int reason, uint32_t data) {
     debug.totalCycles -= sched_total_cycles();
 }
 
+/* flags of index in a paged table, allocating its page, NULL if out of memory */
+static uint8_t *debug_entry(uint8_t **pages, uint32_t index) {
+    uint8_t **page = &pages[index >> DBG_PAGE_SHIFT];
+    if (!*page && !(*page = (uint8_t*)calloc(DBG_PAGE_SIZE, sizeof(uint8_t)))) {
+        return NULL;
+    }
+    return *page + (index & DBG_PAGE_MASK);
+}
+
 void debug_watch(uint32_t addr, int mask, bool set) {
+    uint8_t *entry, old;
     addr &= 0xFFFFFF;
+    if (!set && !debug.addr[addr >> DBG_PAGE_SHIFT]) {
+        return;
+    }
+    if (!(entry = debug_entry(debug.addr, addr))) {
+        return;
+    }
+    old = *entry;
     if (set) {
-        debug.addr[addr] |= mask;
+        *entry |= mask;
     } else {
-        debug.addr[addr] &= ~mask;
+        *entry &= ~mask;
     }
+    debug.watchRead += !!(*entry & DBG_MASK_READ) - !!(old & DBG_MASK_READ);
+    debug.watchWrite += !!(*entry & DBG_MASK_WRITE) - !!(old & DBG_MASK_WRITE);
+    debug.watchExec += !!(*entry & DBG_MASK_EXEC) - !!(old & DBG_MASK_EXEC);
 }
 
 void debug_ports(uint16_t addr, int mask, bool set) {
-    addr &= 0xFFFF;
+    const int all = DBG_MASK_PORT_READ | DBG_MASK_PORT_WRITE | DBG_MASK_PORT_FREEZE;
+    uint8_t *entry, old;
+    if (!set && !debug.port[addr >> DBG_PAGE_SHIFT]) {
+        return;
+    }
+    if (!(entry = debug_entry(debug.port, addr))) {
+        return;
+    }
+    old = *entry;
     if (set) {
-        debug.port[addr] |= mask;
+        *entry |= mask;
     } else {
-        debug.port[addr] &= ~mask;
+        *entry &= ~mask;
     }
+    debug.watchPort += !!(*entry & all) - !!(old & all);
 }
 
 void debug_flag(int mask, bool set) {
@@ -115,8 +150,11 @@ void debug_clear_step(void) {
 
 void debug_inst_start(void) {
     uint32_t pc = cpu.registers.PC;
-    debug.addr[pc] |= DBG_INST_START_MARKER;
-    if (debug.step && !(debug.addr[pc] & DBG_MASK_EXEC) && pc != debug.tempExec) {
+    uint8_t *entry = debug_entry(debug.addr, pc);
+    if (entry) {
+        *entry |= DBG_INST_START_MARKER;
+    }
+    if (debug.step && !(debug.watchExec && (debug_addr_flags(pc) & DBG_MASK_EXEC)) && pc != debug.tempExec) {
         debug.step = debug.stepOver = false;
         debug_open(DBG_STEP, cpu.registers.PC);
     }
@@ -124,8 +162,11 @@ void debug_inst_start(void) {
 
 void debug_inst_fetch(void) {
     uint32_t pc = cpu.registers.PC;
-    debug.addr[pc] |= DBG_INST_MARKER;
-    if (debug.addr[pc] & DBG_MASK_EXEC) {
+    uint8_t *entry = debug_entry(debug.addr, pc);
+    if (entry) {
+        *entry |= DBG_INST_MARKER;
+    }
+    if (debug.watchExec && (debug_addr_flags(pc) & DBG_MASK_EXEC)) {
         debug_open(DBG_BREAKPOINT, pc);
     } else if (pc == debug.tempExec) {
         debug_open(DBG_STEP, pc);
@@ -98,6 +98,11 @@ bool debug_is_open(void);                            /* returns the status of th
 #define DBG_STACK_MASK        (DBG_STACK_SIZE-1)
 #define DBG_ADDR_SIZE         0x1000000
 #define DBG_PORT_SIZE         0x10000
+#define DBG_PAGE_SHIFT        13
+#define DBG_PAGE_SIZE         (1 << DBG_PAGE_SHIFT)
+#define DBG_PAGE_MASK         (DBG_PAGE_SIZE-1)
+#define DBG_ADDR_PAGES        (DBG_ADDR_SIZE >> DBG_PAGE_SHIFT)
+#define DBG_PORT_PAGES        (DBG_PORT_SIZE >> DBG_PAGE_SHIFT)
 #define SIZEOF_DBG_BUFFER     0x1000
 
 typedef struct {
@@ -125,8 +130,11 @@ typedef struct {
     uint32_t bufErrPos;
     uint32_t bufPos;
 
-    uint8_t *addr;
-    uint8_t *port;
+    /* flags per address and port, pages are only allocated once something is set in them */
+    uint8_t *addr[DBG_ADDR_PAGES];
+    uint8_t *port[DBG_PORT_PAGES];
+    uint32_t watchRead, watchWrite, watchExec; /* number of addresses with each mask set */
+    uint32_t watchPort;                        /* number of monitored or frozen ports */
     _Atomic(int) flags;
     _Atomic(bool) open;
     _Atomic(bool) ignore;
@@ -136,6 +144,21 @@ typedef struct {
 
 extern debug_state_t debug;
 
+static inline uint8_t debug_addr_flags(uint32_t addr) {
+    const uint8_t *page = debug.addr[(addr & 0xFFFFFF) >> DBG_PAGE_SHIFT];
+    return page ? page[addr & DBG_PAGE_MASK] : 0;
+}
+
+static inline uint8_t debug_port_flags(uint16_t addr) {
+    const uint8_t *page = debug.port[addr >> DBG_PAGE_SHIFT];
+    return page ? page[addr & DBG_PAGE_MASK] : 0;
+}
+
+/* something is watched or being stepped, so every instruction and access has to be seen */
+static inline bool debug_active(void) {
+    return debug.step || debug.watchRead || debug.watchWrite || debug.watchExec || debug.watchPort;
+}
+
 enum {
     DBG_STEP_IN=DBG_STEP+1,
     DBG_STEP_OUT,
@@ -6,6 +6,7 @@
 #include "os/os.h"
 #include "defines.h"
 #include "schedule.h"
+#include "trace.h"
 #include "debug/debug.h"
 
 #include <stdint.h>
@@ -17,7 +18,8 @@
 #include <emscripten.h>
 #endif
 
-#define IMAGE_VERSION 0xCECE0015
+#define IMAGE_VERSION 0xCECE0025
+#define DELTA_VERSION 0xCEDE0025
 
 void EMSCRIPTEN_KEEPALIVE emu_exit(void) {
     cpu.abort = CPU_ABORT_EXIT;
@@ -39,7 +41,11 @@ bool emu_save(emu_data_t type, const char *path) {
         uint32_t version = IMAGE_VERSION;
         switch (type) {
             case EMU_DATA_IMAGE:
-                success = fwrite(&version, sizeof version, 1, file) == 1 && asic_save(file);
+                success = fwrite(&version, sizeof version, 1, file) == 1 && asic_save(file, false);
+                break;
+            case EMU_DATA_DELTA:
+                version = DELTA_VERSION;
+                success = fwrite(&version, sizeof version, 1, file) == 1 && asic_save(file, true);
                 break;
             case EMU_DATA_ROM:
                 success = fwrite(mem.flash.block, 1, SIZE_FLASH, file) == SIZE_FLASH;
@@ -54,6 +60,38 @@ bool emu_save(emu_data_t type, const char *path) {
     return success;
 }
 
+bool emu_map(emu_data_t type, const char *path) {
+    if (mem.flash.block == NULL || mem.ram.block == NULL || path == NULL) {
+        return false;
+    }
+
+    switch (type) {
+        case EMU_DATA_ROM:
+            return mem_map_flash(path);
+        case EMU_DATA_RAM:
+            return mem_map_ram(path);
+        default:
+            return false;
+    }
+}
+
+int emu_fork(void) {
+    int child;
+
+    /* the writer thread wouldn't exist in the child */
+    if (mem.flash.block == NULL || mem.ram.block == NULL || trace_active) {
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    if ((child = os_fork()) == 0 && !mem_unshare()) {
+        printf("[eZ80-Emu] Couldn't unshare memory in the child.\n");
+        exit(EXIT_FAILURE);
+    }
+    return child;
+}
+
 emu_state_t emu_load(emu_data_t type, const char *path) {
     uint32_t version;
     emu_state_t state = EMU_STATE_INVALID;
@@ -84,13 +122,39 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
         asic_init();
         asic_reset();
 
-        if (!asic_restore(file)) {
+        if (!asic_restore(file, false)) {
             printf("[eZ80-Emu] Error reading image.\n");
             goto rerr;
         }
 
         printf("[eZ80-Emu] Loaded Emulator Image.\n");
 
+        state = EMU_STATE_VALID;
+    } else if (type == EMU_DATA_DELTA) {
+        file = fopen_utf8(path, "rb");
+
+        printf("[eZ80-Emu] Loading Emulator Delta...\n");
+
+        if (!file) {
+            printf("[eZ80-Emu] Delta file nonexistent.\n");
+            goto rerr;
+        }
+
+        if (fread(&version, sizeof(version), 1, file) != 1) goto rerr;
+
+        if (version != DELTA_VERSION) {
+            printf("[eZ80-Emu] Error in versioning.\n");
+            goto rerr;
+        }
+
+        /* applied on top of the base image that is already loaded */
+        if (!asic_restore(file, true)) {
+            printf("[eZ80-Emu] Error reading delta.\n");
+            goto rerr;
+        }
+
+        printf("[eZ80-Emu] Loaded Emulator Delta.\n");
+
         state = EMU_STATE_VALID;
     } else if (type == EMU_DATA_ROM) {
         bool gotType = false;
@@ -130,7 +194,7 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
         }
 
         /* Parse certificate fields to determine model. */
-        for (offset = 0x20000U; offset < 0x40000U; offset += 0x10000U) {
+        for (offset = 0x20000U; offset < 0x40000U && offset < SIZE_FLASH; offset += 0x10000U) {
             outer = mem.flash.block;
 
             /* Outer 0x800(0) field. */
@@ -223,6 +287,8 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
             goto rerr;
         }
 
+        mem_dirty_range(MEM_RAM_BASE, (uint32_t)size);
+        cpu_decode_flush();
         printf("[eZ80-Emu] Loaded RAM Image.\n");
     }
 rerr:
@@ -255,6 +321,52 @@ void emu_run(uint64_t ticks) {
             break;
         }
         cpu_execute();
+        emu_throttle();
+    }
+}
+
+#define EMU_THROTTLE_MIN_SLEEP 1000000u   /* ns, don't bother sleeping for less */
+#define EMU_THROTTLE_MAX_LAG   100000000u /* ns, start over instead of catching up when this far behind */
+
+static struct {
+    bool enabled;
+    bool anchored;
+    uint64_t wall; /* host time at the anchor */
+    uint64_t emu;  /* emulated time at the anchor */
+} throttle;
+
+static uint64_t emu_time_ns(void) {
+    return (uint64_t)cpu.seconds * 1000000000u +
+           (uint64_t)cpu.cycles * 1000000000u / sched.clockRates[CLOCK_CPU];
+}
+
+void emu_set_throttle(bool enabled) {
+    throttle.enabled = enabled;
+    throttle.anchored = false;
+}
+
+/* A halted or idle cpu has already been advanced to its next event, so this sleeps until that event is due */
+void emu_throttle(void) {
+    uint64_t now, emu, deadline;
+    if (!throttle.enabled) {
+        return;
+    }
+    now = os_time_ns();
+    emu = emu_time_ns();
+    if (!throttle.anchored || emu < throttle.emu) {
+        throttle.anchored = true;
+        throttle.wall = now;
+        throttle.emu = emu;
+        return;
+    }
+    deadline = throttle.wall + (emu - throttle.emu);
+    if (deadline > now) {
+        if (deadline - now >= EMU_THROTTLE_MIN_SLEEP) {
+            os_sleep_ns(deadline - now);
+        }
+    } else if (now - deadline > EMU_THROTTLE_MAX_LAG) {
+        throttle.wall = now;
+        throttle.emu = emu;
     }
 }
 
@@ -23,18 +23,28 @@ typedef enum {
     EMU_DATA_IMAGE,
     EMU_DATA_ROM,
     EMU_DATA_RAM,
+    EMU_DATA_DELTA,                                       /* changes since the last EMU_DATA_IMAGE save or load */
 } emu_data_t;
 
 /* emulator functions for frontend use */
 /* these should only be called from the emulation thread if multithreaded */
 emu_state_t emu_load(emu_data_t type, const char *path);  /* load an emulator state */
 bool emu_save(emu_data_t type, const char *path);         /* save an emulator state */
+bool emu_map(emu_data_t type, const char *path);          /* keep ROM or RAM in a file, writes persist without saving */
+int emu_fork(void);                                       /* copy on write fork of the emulator into a child process, see below */
 void emu_run(uint64_t ticks);                             /* core emulation function, call after emu_load */
 void emu_set_run_rate(uint32_t rate);                     /* how many ticks per second for emu_run */
 uint32_t emu_get_run_rate(void);                          /* getter for the above */
+void emu_set_throttle(bool enabled);                      /* keep emu_run from running ahead of real time */
+void emu_throttle(void);                                  /* sleep until the wall clock catches up with emulated time */
 void emu_reset(void);                                     /* reset emulation as if the reset button was pressed */
 void emu_exit(void);                                      /* exit emulation */
 
+/* emu_fork returns 0 in the child, the child's id in the parent (wait for it with os_wait_child) and -1 if the */
+/* platform can't fork. The child continues from the same state with its own copy of everything, guest memory is */
+/* only copied as pages get written, and a ROM or RAM file kept with emu_map stays with the parent. */
+/* other threads, such as a gui, don't exist in the child so fork from a headless emulation loop */
+
 /* gui callbacks called by the core */
 /* if you want to port CEmu to another platform, simply reimplement these callbacks */
 /* if you want debugging support, don't forget about the debug callbacks as well */
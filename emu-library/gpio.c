@@ -0,0 +1,140 @@
+#include "gpio.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Each pin's mode comes from its ALT2, ALT1 and DDR bits: 000 drives DR onto the pin, 010 is open
+ * drain and 011 open source, everything else (input, alternate function, interrupt modes) leaves the
+ * pin to whatever is outside. Reading DR returns the pin levels.
+ *
+ * Device models subscribe to the pins they listen to, and are only called when a register write
+ * changes the level of one of them, so code rewriting the same value costs nothing extra.
+ */
+
+#define GPIO_BASE            0x9A
+#define GPIO_MAX_SUBSCRIBERS 8
+
+gpio_state_t gpio;
+
+/* Not part of the state, models subscribe once when they are plugged in */
+static struct {
+    gpio_port_t port;
+    uint8_t mask;
+    gpio_callback_t callback;
+} gpio_subscribers[GPIO_MAX_SUBSCRIBERS];
+static unsigned int gpio_subscriber_count;
+
+uint8_t gpio_pins(gpio_port_t port) {
+    const gpio_port_state_t *p = &gpio.port[port];
+    uint8_t pushPull = ~p->alt2 & ~p->alt1 & ~p->ddr;
+    uint8_t openDrain = ~p->alt2 & p->alt1 & ~p->ddr;
+    uint8_t openSource = ~p->alt2 & p->alt1 & p->ddr;
+    uint8_t high = (pushPull | openSource) & p->dr;
+    uint8_t low = (pushPull | openDrain) & ~p->dr;
+
+    return high | (~(high | low) & p->input);
+}
+
+bool gpio_subscribe(gpio_port_t port, uint8_t mask, gpio_callback_t callback) {
+    if (gpio_subscriber_count == GPIO_MAX_SUBSCRIBERS) {
+        return false;
+    }
+    gpio_subscribers[gpio_subscriber_count].port = port;
+    gpio_subscribers[gpio_subscriber_count].mask = mask;
+    gpio_subscribers[gpio_subscriber_count].callback = callback;
+    gpio_subscriber_count++;
+    return true;
+}
+
+/* Devices driving pins, this doesn't call anyone back */
+void gpio_set_input(gpio_port_t port, uint8_t mask, uint8_t value) {
+    gpio.port[port].input = (gpio.port[port].input & ~mask) | (value & mask);
+}
+
+static void gpio_notify(gpio_port_t port, uint8_t old) {
+    uint8_t pins = gpio_pins(port);
+    uint8_t changed = pins ^ old;
+    unsigned int i;
+
+    if (!changed) {
+        return;
+    }
+    for (i = 0; i < gpio_subscriber_count; i++) {
+        if (gpio_subscribers[i].port == port && (gpio_subscribers[i].mask & changed)) {
+            gpio_subscribers[i].callback(port, pins, changed);
+        }
+    }
+}
+
+static uint8_t gpio_read(const uint16_t pio, bool peek) {
+    uint8_t index = pio - GPIO_BASE;
+    gpio_port_t port = index >> 2;
+    gpio_port_state_t *p = &gpio.port[port];
+    (void)peek;
+
+    switch (index & 3) {
+        case 0:
+            return gpio_pins(port);
+        case 1:
+            return p->ddr;
+        case 2:
+            return p->alt1;
+        default:
+            return p->alt2;
+    }
+}
+
+static void gpio_write(const uint16_t pio, const uint8_t value, bool poke) {
+    uint8_t index = pio - GPIO_BASE;
+    gpio_port_t port = index >> 2;
+    gpio_port_state_t *p = &gpio.port[port];
+    uint8_t old = gpio_pins(port);
+    (void)poke;
+
+    switch (index & 3) {
+        case 0:
+            p->dr = value;
+            break;
+        case 1:
+            p->ddr = value;
+            break;
+        case 2:
+            p->alt1 = value;
+            break;
+        default:
+            p->alt2 = value;
+            break;
+    }
+    gpio_notify(port, old);
+}
+
+void gpio_reset(void) {
+    gpio_port_t port;
+
+    /* every pin an input */
+    memset(&gpio, 0, sizeof(gpio));
+    for (port = GPIO_PORT_B; port < GPIO_NUM_PORTS; port++) {
+        gpio.port[port].ddr = 0xFF;
+    }
+
+    printf("[eZ80-Emu] GPIO reset.\n");
+}
+
+static const eZ80portrange_t device = {
+    .read  = gpio_read,
+    .write = gpio_write
+};
+
+eZ80portrange_t init_gpio(void) {
+    printf("[eZ80-Emu] Initialized GPIO ports...\n");
+    return device;
+}
+
+bool gpio_save(FILE *image) {
+    return fwrite(&gpio, sizeof(gpio), 1, image) == 1;
+}
+
+bool gpio_restore(FILE *image) {
+    return fread(&gpio, sizeof(gpio), 1, image) == 1;
+}
@@ -0,0 +1,49 @@
+#ifndef GPIO_H
+#define GPIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "port.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* eZ80F92 GPIO ports B, C and D at 0x9A-0xA5, DR, DDR, ALT1 and ALT2 for each */
+typedef enum {
+    GPIO_PORT_B,
+    GPIO_PORT_C,
+    GPIO_PORT_D,
+    GPIO_NUM_PORTS
+} gpio_port_t;
+
+typedef struct gpio_port_state {
+    uint8_t dr, ddr, alt1, alt2;
+    uint8_t input;                  /* levels external devices put on the pins */
+} gpio_port_state_t;
+
+typedef struct gpio_state {
+    gpio_port_state_t port[GPIO_NUM_PORTS];
+} gpio_state_t;
+
+extern gpio_state_t gpio;
+
+/* Called after a register write changed the level of a subscribed pin, with the new levels of the
+ * whole port and the pins that changed */
+typedef void (*gpio_callback_t)(gpio_port_t port, uint8_t pins, uint8_t changed);
+
+eZ80portrange_t init_gpio(void);
+void gpio_reset(void);
+bool gpio_restore(FILE *image);
+bool gpio_save(FILE *image);
+
+bool gpio_subscribe(gpio_port_t port, uint8_t mask, gpio_callback_t callback);
+void gpio_set_input(gpio_port_t port, uint8_t mask, uint8_t value);
+uint8_t gpio_pins(gpio_port_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,8 +26,35 @@ void intrpt_set(uint32_t mask, bool set) {
     }
 }
 
+/* Vectors of the on-chip sources, lowest vector (highest priority) first */
+static const struct {
+    uint32_t mask;
+    uint8_t vector;
+} intrpt_vectors[] = {
+    { INT_PRT0,  0x0A },
+    { INT_PRT1,  0x0C },
+    { INT_PRT2,  0x0E },
+    { INT_PRT3,  0x10 },
+    { INT_PRT4,  0x12 },
+    { INT_PRT5,  0x14 },
+    { INT_UART0, 0x18 },
+};
+
+/* Vector of the highest priority on-chip source requesting, 0 if there is none */
+uint8_t intrpt_vector(void) {
+    uint32_t pending = intrpt[0].status & intrpt[0].enabled;
+    size_t i;
+    for (i = 0; i < sizeof(intrpt_vectors) / sizeof(*intrpt_vectors); i++) {
+        if (pending & intrpt_vectors[i].mask) {
+            return intrpt_vectors[i].vector;
+        }
+    }
+    return 0;
+}
+
 void intrpt_reset() {
     memset(&intrpt, 0, sizeof(intrpt));
+    intrpt[0].enabled = INT_VECTORED;
     intrpt_set(INT_PWR, true);
 }
 
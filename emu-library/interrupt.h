@@ -11,10 +11,13 @@ extern "C" {
 #include <stdbool.h>
 
 #define INT_ON        (1 <<  0)
-#define INT_TIMER1    (1 <<  1)
-#define INT_TIMER2    (1 <<  2)
-#define INT_TIMER3    (1 <<  3)
-#define INT_OSTIMER   (1 <<  4)
+#define INT_PRT0      (1 <<  1)
+#define INT_PRT1      (1 <<  2)
+#define INT_PRT2      (1 <<  3)
+#define INT_PRT3      (1 <<  4)
+#define INT_PRT4      (1 <<  5)
+#define INT_PRT5      (1 <<  6)
+#define INT_UART0     (1 <<  7)
 #define INT_KEYPAD    (1 << 10)
 #define INT_LCD       (1 << 11)
 #define INT_RTC       (1 << 12)
@@ -22,6 +25,9 @@ extern "C" {
 #define INT_PWR       (1 << 15)
 #define INT_WAKE      (1 << 19)
 
+/* eZ80F92 on-chip sources, gated by their own enable bits and acknowledged with a vector */
+#define INT_VECTORED  (INT_PRT0 | INT_PRT1 | INT_PRT2 | INT_PRT3 | INT_PRT4 | INT_PRT5 | INT_UART0)
+
 typedef struct interrupt_state {
     uint32_t status   : 22;
     uint32_t          :  2;
@@ -39,6 +45,7 @@ eZ80portrange_t init_intrpt(void);
 void intrpt_reset(void);
 void intrpt_pulse(uint32_t int_num);
 void intrpt_set(uint32_t int_num, bool set);
+uint8_t intrpt_vector(void);
 bool intrpt_restore(FILE *image);
 bool intrpt_save(FILE *image);
 
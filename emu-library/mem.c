@@ -5,7 +5,10 @@
 #include "bus.h"
 #include "flash.h"
 #include "control.h"
+#include "trace.h"
+#include "defines.h"
 #include "debug/debug.h"
+#include "os/os.h"
 
 #include <assert.h>
 #include <string.h>
@@ -18,14 +21,134 @@
 /* Global MEMORY state */
 mem_state_t mem;
 
-extern uint8_t *memory;
+/* 4K page table over the 24-bit address space. Pages with a host pointer are accessed directly,
+ * the others go through their handlers. */
+static struct {
+    uint8_t *read[MEM_NUM_PAGES];
+    uint8_t *write[MEM_NUM_PAGES];
+    mem_read_handler_t readHandler[MEM_NUM_PAGES];
+    mem_write_handler_t writeHandler[MEM_NUM_PAGES];
+} mem_map;
 
+/* Blocks backed by a host file rather than anonymous pages */
+static bool mem_flash_file, mem_ram_file;
+
+/* Guest pages written since the last full snapshot, and the snapshot they are relative to */
+static uint8_t mem_dirty[MEM_NUM_PAGES / 8];
+static uint64_t mem_base;
+
+static inline void mem_page_touch(uint32_t page) {
+    mem_dirty[page >> 3] |= 1 << (page & 7);
+}
+
+static inline bool mem_page_dirty(uint32_t page) {
+    return mem_dirty[page >> 3] & (1 << (page & 7));
+}
+
+void mem_dirty_range(uint32_t addr, uint32_t size) {
+    uint32_t page;
+    if (!size) {
+        return;
+    }
+    addr &= 0xFFFFFF;
+    for (page = addr >> MEM_PAGE_SHIFT; page <= (addr + size - 1) >> MEM_PAGE_SHIFT && page < MEM_NUM_PAGES; page++) {
+        mem_page_touch(page);
+    }
+}
+
+static uint8_t mem_read_unmapped(uint32_t addr, bool peek) {
+    (void)addr;
+    return mem_read_unmapped_other(!peek);
+}
+
+static void mem_write_ignored(uint32_t addr, uint8_t value, bool poke) {
+    (void)addr;
+    (void)value;
+    (void)poke;
+}
+
+void mem_map_memory(uint32_t base, uint32_t size, uint8_t *host, bool writable) {
+    uint32_t page;
+    for (page = base >> MEM_PAGE_SHIFT; page < (base + size) >> MEM_PAGE_SHIFT; page++, host += MEM_PAGE_SIZE) {
+        mem_map.read[page] = host;
+        mem_map.write[page] = writable ? host : NULL;
+        mem_map.readHandler[page] = mem_read_unmapped;
+        mem_map.writeHandler[page] = mem_write_ignored;
+    }
+}
+
+void mem_map_handlers(uint32_t base, uint32_t size, mem_read_handler_t read, mem_write_handler_t write) {
+    uint32_t page;
+    for (page = base >> MEM_PAGE_SHIFT; page < (base + size) >> MEM_PAGE_SHIFT; page++) {
+        mem_map.read[page] = mem_map.write[page] = NULL;
+        mem_map.readHandler[page] = read ? read : mem_read_unmapped;
+        mem_map.writeHandler[page] = write ? write : mem_write_ignored;
+    }
+}
+
+/* Rebuild the Agon layout, flash is read only until the flash controller is modelled */
+void mem_remap(void) {
+    mem_map_handlers(0, 0x1000000, NULL, NULL);
+    mem_map_memory(MEM_FLASH_BASE, SIZE_FLASH, mem.flash.block, false);
+    mem_map_memory(MEM_RAM_BASE, SIZE_RAM, mem.ram.block, true);
+    mem_map_memory(MEM_SRAM_BASE, SIZE_SRAM, mem.sram.block, true);
+    cpu_decode_flush();
+}
+
+/* Host pointer to size bytes at addr if they are all in pages of table that are contiguous on the host */
+static uint8_t *mem_map_ptr(uint8_t *const *table, uint32_t addr, uint32_t size) {
+    uint32_t page, last;
+    uint8_t *host;
+    if (!size || addr > 0xFFFFFF || size > 0x1000000 - addr) {
+        return NULL;
+    }
+    page = addr >> MEM_PAGE_SHIFT;
+    last = (addr + size - 1) >> MEM_PAGE_SHIFT;
+    if (!(host = table[page])) {
+        return NULL;
+    }
+    while (page != last) {
+        if (table[page + 1] != table[page] + MEM_PAGE_SIZE) {
+            return NULL;
+        }
+        page++;
+    }
+    return host + (addr & MEM_PAGE_MASK);
+}
+
+static const uint8_t flash_unlock_sequence[FLASH_UNLOCK_LENGTH] = { 0xF3, 0x18, 0x00, 0xF3, 0xF3, 0xED, 0x7E, 0xED, 0x56, 0xED, 0x39, 0x28, 0xED, 0x38, 0x28, 0xCB, 0x57 };
+
+/* flash_unlock_next[matched][byte] is how much of the sequence is matched after fetching byte, the
+ * KMP automaton of the sequence, so overlapping starts are followed without keeping old fetches */
+uint8_t flash_unlock_next[FLASH_UNLOCK_LENGTH + 1][256];
+
+static void flash_unlock_init(void) {
+    unsigned int state, restart = 0;
+    memset(flash_unlock_next[0], 0, sizeof(flash_unlock_next[0]));
+    flash_unlock_next[0][flash_unlock_sequence[0]] = 1;
+    for (state = 1; state <= FLASH_UNLOCK_LENGTH; state++) {
+        memcpy(flash_unlock_next[state], flash_unlock_next[restart], sizeof(flash_unlock_next[state]));
+        if (state < FLASH_UNLOCK_LENGTH) {
+            flash_unlock_next[state][flash_unlock_sequence[state]] = state + 1;
+            restart = flash_unlock_next[restart][flash_unlock_sequence[state]];
+        }
+    }
+}
+
+/* The whole sequence was just fetched, it only unlocks from privileged code running in flash */
+void mem_flash_unlock(uint32_t addr) {
+    if (addr - MEM_FLASH_BASE < SIZE_FLASH && protected_ports_unlocked() && !unprivileged_code()) {
+        control.flashUnlocked |= 1 << 3;
+    }
+}
 
 void mem_init(void) {
     unsigned int i;
 
-    /* Allocate FLASH memory */
-    mem.flash.block = (uint8_t*)malloc(SIZE_FLASH);
+    flash_unlock_init();
+
+    /* Allocate FLASH memory, erased */
+    mem.flash.block = os_alloc_pages(SIZE_FLASH);
     memset(mem.flash.block, 0xFF, SIZE_FLASH);
 
     for (i = 0; i < NUM_8K_SECTORS; i++) {
@@ -41,26 +164,104 @@ void mem_init(void) {
     }
     mem.flash.sector[1].ipb = 0;
 
-    /* Allocate RAM */
-    // mem.ram.block = (uint8_t*)calloc(SIZE_RAM, 1);
-    mem.ram.block = memory;
+    /* Allocate RAM, pages the guest never touches are never committed */
+    mem.ram.block = os_alloc_pages(SIZE_RAM);
+    mem.sram.block = os_alloc_pages(SIZE_SRAM);
+    mem_remap();
 
     mem.flash.write = 0;
     mem.flash.command = FLASH_NO_COMMAND;
     printf("[eZ80-Emu] Initialized Memory...\n");
 }
 
+static void mem_free_block(uint8_t *block, size_t size, bool file) {
+    if (file) {
+        os_unmap_file(block, size);
+    } else {
+        os_free_pages(block, size);
+    }
+}
+
 void mem_free(void) {
-    free(mem.ram.block);
+    mem_free_block(mem.ram.block, SIZE_RAM, mem_ram_file);
     mem.ram.block = NULL;
-    free(mem.flash.block);
+    os_free_pages(mem.sram.block, SIZE_SRAM);
+    mem.sram.block = NULL;
+    mem_free_block(mem.flash.block, SIZE_FLASH, mem_flash_file);
     mem.flash.block = NULL;
+    mem_ram_file = mem_flash_file = false;
+    memset(mem_dirty, 0, sizeof(mem_dirty));
+    mem_base = 0;
     printf("[eZ80-Emu] Freed Memory.\n");
 }
 
+static void mem_flash_sectors(void) {
+    unsigned int i;
+    for (i = 0; i < NUM_8K_SECTORS; i++) {
+        mem.flash.sector8k[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_8K];
+    }
+    for (i = 0; i < NUM_SECTORS; i++) {
+        mem.flash.sector[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_64K];
+    }
+}
+
+/* Swap a block for a mapping of path, a new file starts out with the current contents of the block */
+static bool mem_map_file(uint8_t **block, size_t size, bool *file, const char *path) {
+    bool created = false;
+    uint8_t *mapped = os_map_file(path, size, &created);
+    if (!mapped) {
+        printf("[eZ80-Emu] Couldn't map %s, an existing file has to be %u bytes.\n", path, (unsigned int)size);
+        return false;
+    }
+    if (created) {
+        memcpy(mapped, *block, size);
+    }
+    mem_free_block(*block, size, *file);
+    *block = mapped;
+    *file = true;
+    mem_remap();
+    printf("[eZ80-Emu] Mapped %s.\n", path);
+    return true;
+}
+
+bool mem_map_flash(const char *path) {
+    if (!mem_map_file(&mem.flash.block, SIZE_FLASH, &mem_flash_file, path)) {
+        return false;
+    }
+    mem_flash_sectors();
+    return true;
+}
+
+bool mem_map_ram(const char *path) {
+    return mem_map_file(&mem.ram.block, SIZE_RAM, &mem_ram_file, path);
+}
+
+/* Swap a file backed block for private pages holding the same contents */
+static bool mem_unshare_block(uint8_t **block, size_t size, bool *file) {
+    uint8_t *copy;
+    if (!*file) {
+        return true;
+    }
+    if (!(copy = os_alloc_pages(size))) {
+        return false;
+    }
+    memcpy(copy, *block, size);
+    os_unmap_file(*block, size);
+    *block = copy;
+    *file = false;
+    return true;
+}
+
+bool mem_unshare(void) {
+    bool ret = mem_unshare_block(&mem.flash.block, SIZE_FLASH, &mem_flash_file) &&
+               mem_unshare_block(&mem.ram.block, SIZE_RAM, &mem_ram_file);
+    mem_flash_sectors();
+    mem_remap();
+    return ret;
+}
+
 void mem_reset(void) {
     // memset(mem.ram.block, 0, SIZE_RAM);
-    mem.ram.block = memory;
     mem.flash.command = FLASH_NO_COMMAND;
     printf("[eZ80-Emu] Memory reset.\n");
 }
@@ -89,62 +290,75 @@ static void fix_size(uint32_t *addr, int32_t *size) {
     }
 }
 
-static uint32_t addr_block(uint32_t *addr, int32_t size, void **block, uint32_t *block_size) {
-    if (*addr < 0xD00000) {
-        flash_block(addr, block_size);
-        *block = mem.flash.block;
-        *block_size = SIZE_FLASH;
-    } else if (*addr < 0xE00000) {
-        *addr &= 0x07FFFF;
-        *block = mem.ram.block;
-        *block_size = SIZE_RAM;
-    } else if (*addr < 0xE30800) {
-        *addr -= 0xE30200;
-        *block = lcd.palette;
-        *block_size = sizeof lcd.palette;
-    } else {
-        *addr -= 0xE30800;
-        *block = lcd.crsrImage;
-        *block_size = sizeof lcd.crsrImage;
-    }
-    return *addr + (unsigned int)size;
-}
-
 void *phys_mem_ptr(uint32_t addr, int32_t size) {
-    void *block;
-    uint32_t block_size, end_addr;
     fix_size(&addr, &size);
-    end_addr = addr_block(&addr, size, &block, &block_size);
-    if (addr <= end_addr && addr <= block_size && end_addr <= block_size && block) {
-        return (uint8_t *)block + addr;
-    }
-    return NULL;
+    return mem_map_ptr(mem_map.read, addr & 0xFFFFFF, (uint32_t)size);
 }
 
-void *virt_mem_cpy(void *buf, uint32_t addr, int32_t size) {
-    uint8_t *dest = buf, *save_dest;
-    void *block;
-    uint32_t temp_addr, block_size, end_addr;
-    fix_size(&addr, &size);
-    if (!dest) {
-        dest = malloc((unsigned long)size);
-    }
-    save_dest = dest;
+/* Host pointer for a CPU address range that can be read directly, NULL if any byte needs a handler */
+const uint8_t *mem_fetch_ptr(uint32_t addr, uint32_t size) {
+    return mem_map_ptr(mem_map.read, addr, size);
+}
+
+/* Host pointer for a CPU address range that can be written directly, NULL if any byte needs a handler */
+uint8_t *mem_cpu_ptr(uint32_t addr, uint32_t size) {
+    return mem_map_ptr(mem_map.write, addr, size);
+}
+
+/* Copy a range of the address space a run of pages at a time: memory that continues on the host in
+ * one memcpy, unmapped space as open bus and anything else through its handler. A dma access drives
+ * the bus so it sees a fresh open bus value per byte and goes through the handlers as a real read. */
+static void mem_copy_range(uint8_t *dest, uint32_t addr, uint32_t size, bool dma) {
     while (size) {
-        temp_addr = addr;
-        end_addr = addr_block(&temp_addr, size, &block, &block_size);
-        if (temp_addr <= end_addr && temp_addr < block_size && block) {
-            uint32_t temp_size = (end_addr <= block_size ? end_addr : block_size) - temp_addr;
-            memcpy(dest, (uint8_t *)block + temp_addr, temp_size);
-            dest += temp_size;
-            addr += temp_size;
-            size -= temp_size;
+        uint32_t page = addr >> MEM_PAGE_SHIFT;
+        uint32_t offset = addr & MEM_PAGE_MASK;
+        uint32_t chunk = MEM_PAGE_SIZE - offset, i;
+        const uint8_t *host = mem_map.read[page];
+        mem_read_handler_t handler = mem_map.readHandler[page];
+
+        if (host) {
+            while (chunk < size && page + 1 < MEM_NUM_PAGES && mem_map.read[page + 1] == mem_map.read[page] + MEM_PAGE_SIZE) {
+                page++;
+                chunk += MEM_PAGE_SIZE;
+            }
+        } else {
+            while (chunk < size && page + 1 < MEM_NUM_PAGES && !mem_map.read[page + 1] && mem_map.readHandler[page + 1] == handler) {
+                page++;
+                chunk += MEM_PAGE_SIZE;
+            }
+        }
+        if (chunk > size) {
+            chunk = size;
+        }
+
+        if (host) {
+            memcpy(dest, host + offset, chunk);
+        } else if (handler == mem_read_unmapped && !dma) {
+            memset(dest, mem_read_unmapped_other(false), chunk);
+        } else if (handler == mem_read_unmapped) {
+            for (i = 0; i < chunk; i++) {
+                dest[i] = mem_read_unmapped_other(true);
+            }
         } else {
-            *dest++ = mem_peek_byte(addr++);
-            size--;
+            for (i = 0; i < chunk; i++) {
+                dest[i] = handler(addr + i, !dma);
+            }
         }
+
+        dest += chunk;
+        addr = (addr + chunk) & 0xFFFFFF;
+        size -= chunk;
     }
-    return save_dest;
+}
+
+void *virt_mem_cpy(void *buf, uint32_t addr, int32_t size) {
+    uint8_t *dest = buf;
+    fix_size(&addr, &size);
+    if (!dest && !(dest = malloc((unsigned long)size))) {
+        return NULL;
+    }
+    mem_copy_range(dest, addr & 0xFFFFFF, (uint32_t)size, false);
+    return dest;
 }
 
 void *virt_mem_dup(uint32_t addr, int32_t size) {
@@ -152,30 +366,13 @@ void *virt_mem_dup(uint32_t addr, int32_t size) {
 }
 
 void *mem_dma_cpy(void *buf, uint32_t addr, int32_t size) {
-    uint8_t *dest = buf, *save_dest;
+    uint8_t *dest = buf;
     fix_size(&addr, &size);
-    if (!dest) {
-        dest = malloc((unsigned long)size);
-    }
-    save_dest = dest;
-    while (size) {
-        addr &= 0x07FFFF;
-        if (addr + (unsigned int)size > addr && addr + (unsigned int)size <= SIZE_RAM) {
-            memcpy(dest, &mem.ram.block[addr], (unsigned long)size);
-            break;
-        }
-        if (addr < SIZE_RAM) {
-            uint32_t temp_size = SIZE_RAM - addr;
-            memcpy(dest, &mem.ram.block[addr], temp_size);
-            dest += temp_size;
-            addr += temp_size;
-            size -= temp_size;
-        } else {
-            *dest++ = mem_read_unmapped_ram(true);
-            size--;
-        }
+    if (!dest && !(dest = malloc((unsigned long)size))) {
+        return NULL;
     }
-    return save_dest;
+    mem_copy_range(dest, addr & 0xFFFFFF, (uint32_t)size, true);
+    return dest;
 }
 
 static void flash_reset_write_index(uint32_t addr, uint8_t byte) {
@@ -198,6 +395,7 @@ static void flash_write(uint32_t addr, uint8_t byte) {
 
     if (valid == true) {
         mem.flash.block[addr] &= byte;
+        mem_dirty_range(MEM_FLASH_BASE + addr, 1);
     }
 }
 
@@ -220,6 +418,7 @@ static void flash_erase(uint32_t addr, uint8_t byte) {
         }
     }
 
+    mem_dirty_range(MEM_FLASH_BASE, SIZE_FLASH);
     printf("[eZ80-Emu] Erased Unlocked Sectors.\n");
 }
 
@@ -233,11 +432,13 @@ static void flash_erase_sector(uint32_t addr, uint8_t byte) {
         selected = addr / SIZE_FLASH_SECTOR_8K;
         if ((mem.flash.sector8k[selected].ipb & mem.flash.sector8k[selected].dpb) == 1) {
             memset(mem.flash.sector8k[selected].ptr, 0xff, SIZE_FLASH_SECTOR_8K);
+            mem_dirty_range(MEM_FLASH_BASE + selected * SIZE_FLASH_SECTOR_8K, SIZE_FLASH_SECTOR_8K);
         }
     } else {
         selected = addr / SIZE_FLASH_SECTOR_64K;
         if ((mem.flash.sector[selected].ipb & mem.flash.sector[selected].dpb) == 1) {
             memset(mem.flash.sector[selected].ptr, 0xff, SIZE_FLASH_SECTOR_64K);
+            mem_dirty_range(MEM_FLASH_BASE + selected * SIZE_FLASH_SECTOR_64K, SIZE_FLASH_SECTOR_64K);
         }
     }
 }
@@ -593,24 +794,9 @@ static void mem_write_flash(uint32_t addr, uint8_t byte) {
     }
 }
 
-static bool detect_flash_unlock_sequence(uint8_t current) {
-    static const uint8_t flash_unlock_sequence[] = { 0xF3, 0x18, 0x00, 0xF3, 0xF3, 0xED, 0x7E, 0xED, 0x56, 0xED, 0x39, 0x28, 0xED, 0x38, 0x28, 0xCB, 0x57 };
-    uint8_t i;
-    if (current != flash_unlock_sequence[sizeof(flash_unlock_sequence) - 1] ||
-        !protected_ports_unlocked() || unprivileged_code()) {
-        return false;
-    }
-    for (i = 1; i != sizeof(flash_unlock_sequence); i++) {
-        if (mem.buffer[(mem.fetch + i) & (sizeof(mem.buffer) - 1)] != flash_unlock_sequence[i - 1]) {
-            return false;
-        }
-    }
-    return true;
-}
-
 uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
     uint8_t value = 0;
-    uint32_t ramAddr, select;
+    const uint8_t *page;
 
     addr &= 0xFFFFFF;
 #ifdef DEBUG_SUPPORT
@@ -626,74 +812,50 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
                 }
             }
         }
-        if (debug.addr[addr] & DBG_MASK_READ) {
+        if (debug.watchRead && (debug_addr_flags(addr) & DBG_MASK_READ)) {
             debug_open(DBG_WATCHPOINT_READ, addr);
         }
     }
 #endif
-    ramAddr = addr & 0x7FFFF;
-    value = mem.ram.block[ramAddr];
-
-    // switch((addr >> 20) & 0xF) {
-    //     /* FLASH */
-    //     case 0x0: case 0x1: case 0x2: case 0x3:
-    //     case 0x4: case 0x5: case 0x6: case 0x7:
-    //         value = mem_read_flash(addr);
-    //         if (fetch && detect_flash_unlock_sequence(value)) {
-    //             control.flashUnlocked |= 1 << 3;
-    //         }
-    //         break;
-
-    //     /* UNMAPPED */
-    //     case 0x8: case 0x9: case 0xA: case 0xB: case 0xC:
-    //         value = mem_read_unmapped_other(true);
-    //         cpu.cycles += 258;
-    //         break;
-
-    //     /* RAM */
-    //     case 0xD:
-    //         sched_process_pending_dma(4);
-    //         ramAddr = addr & 0x7FFFF;
-    //         if (ramAddr < 0x65800) {
-    //             value = mem.ram.block[ramAddr];
-    //         } else {
-    //             value = mem_read_unmapped_ram(true);
-    //         }
-    //         break;
-
-    //     /* MMIO <-> Advanced Perphrial Bus */
-    //     case 0xE: case 0xF:
-    //         if (mmio_mapped(addr, select)) {
-    //             value = port_read_byte(mmio_port(addr, select));
-    //         } else {
-    //             if (addr >= 0xFB0000 && addr < 0xFF0000) {
-    //                 cpu.cycles += 3;
-    //             } else {
-    //                 cpu.cycles += 2;
-    //             }
-    //         }
-    //         break;
-    // }
+    page = mem_map.read[addr >> MEM_PAGE_SHIFT];
+    if (likely(page)) {
+        value = page[addr & MEM_PAGE_MASK];
+    } else {
+        value = mem_map.readHandler[addr >> MEM_PAGE_SHIFT](addr, false);
+    }
+
     if (fetch) {
-        mem.buffer[++mem.fetch] = value;
-        if (unprivileged_code()) {
+        mem_fetch_track(addr, value);
+        if ((control.flashUnlocked & 1 << 3) && unprivileged_code()) {
             control.flashUnlocked &= ~(1 << 3);
         }
     } else if (addr >= control.protectedStart && addr <= control.protectedEnd && unprivileged_code()) {
         value = 0; /* reads from protected memory return 0 */
     }
+    trace_access(fetch ? TRACE_MEM_FETCH : TRACE_MEM_READ, addr, value);
     return value;
 } /* end mem_read_cpu */
 
 void mem_write_cpu(uint32_t addr, uint8_t value) {
-    uint32_t ramAddr, select;
+    uint8_t *page;
     addr &= 0xFFFFFF;
-
-    ramAddr = addr & 0x7FFFF;
-    mem.ram.block[ramAddr] = value;
+    trace_access(TRACE_MEM_WRITE, addr, value);
+
+    page = mem_map.write[addr >> MEM_PAGE_SHIFT];
+    if (likely(page)) {
+        page += addr & MEM_PAGE_MASK;
+        if (*page != value) {
+            *page = value;
+            mem.writes++;
+            mem_page_touch(addr >> MEM_PAGE_SHIFT);
+            cpu_decode_invalidate(addr);
+        }
+    } else {
+        mem_map.writeHandler[addr >> MEM_PAGE_SHIFT](addr, value, false);
+    }
 
 // #ifdef DEBUG_SUPPORT
-//     if ((debug.addr[addr] &= ~(DBG_INST_START_MARKER | DBG_INST_MARKER)) & DBG_MASK_WRITE) {
+//     if (debug.watchWrite && (debug_addr_flags(addr) & DBG_MASK_WRITE)) {
 //         debug_open(DBG_WATCHPOINT_WRITE, addr);
 //     }
 // #endif
@@ -785,20 +947,12 @@ void mem_write_cpu(uint32_t addr, uint8_t value) {
 } /* end mem_write_cpu */
 
 uint8_t mem_peek_byte(uint32_t addr) {
-    uint8_t value = 0;
-    uint32_t select;
+    const uint8_t *page;
     addr &= 0xFFFFFF;
-    if (addr < 0xE00000) {
-        uint8_t *ptr;
-        if ((ptr = phys_mem_ptr(addr, 1))) {
-            value = *ptr;
-        } else {
-            value = mem_read_unmapped_ram(false);
-        }
-    } else if (mmio_mapped(addr, select)) {
-        value = port_peek_byte(mmio_port(addr, select));
+    if ((page = mem_map.read[addr >> MEM_PAGE_SHIFT])) {
+        return page[addr & MEM_PAGE_MASK];
     }
-    return value;
+    return mem_map.readHandler[addr >> MEM_PAGE_SHIFT](addr, true);
 }
 uint16_t mem_peek_short(uint32_t addr) {
     return mem_peek_byte(addr)
@@ -818,16 +972,20 @@ uint32_t mem_peek_word(uint32_t addr, bool mode) {
     }
 }
 
+/* Pokes also reach read only pages so the debugger can patch flash */
 void mem_poke_byte(uint32_t addr, uint8_t value) {
-    uint32_t select;
+    uint8_t *page;
     addr &= 0xFFFFFF;
-    if (addr < 0xE00000) {
-        uint8_t *ptr;
-        if ((ptr = phys_mem_ptr(addr, 1))) {
-            *ptr = value;
+    if ((page = mem_map.write[addr >> MEM_PAGE_SHIFT]) || (page = mem_map.read[addr >> MEM_PAGE_SHIFT])) {
+        page += addr & MEM_PAGE_MASK;
+        if (*page != value) {
+            *page = value;
+            mem.writes++;
+            mem_page_touch(addr >> MEM_PAGE_SHIFT);
+            cpu_decode_invalidate(addr);
         }
-    } else if (mmio_mapped(addr, select)) {
-        port_poke_byte(mmio_port(addr, select), value);
+    } else {
+        mem_map.writeHandler[addr >> MEM_PAGE_SHIFT](addr, value, true);
     }
 }
 void mem_poke_short(uint32_t addr, uint16_t value) {
@@ -872,41 +1030,111 @@ uint8_t mem_read_unmapped_other(bool update) {
     return value;
 }
 
-bool mem_save(FILE *image) {
+/* Images store memory as page records, a full image has every mapped page and a delta only the pages
+ * written since the last full snapshot. Deltas are tagged with their base so they can't be applied to
+ * a different one. */
+#define MEM_IMAGE_END 0xFFFF
+
+bool mem_save(FILE *image, bool delta) {
+    uint16_t page, end = MEM_IMAGE_END;
+
     assert(mem.flash.block);
     assert(mem.ram.block);
+    assert(mem.sram.block);
+
+    if (delta && !mem_base) {
+        return false;
+    }
+    if (!delta) {
+        mem_base = os_time_ns() | 1;
+    }
+    if (fwrite(&mem, sizeof(mem), 1, image) != 1 ||
+        fwrite(&mem_base, sizeof(mem_base), 1, image) != 1) {
+        return false;
+    }
+    for (page = 0; page < MEM_NUM_PAGES; page++) {
+        if (!mem_map.read[page] || (delta && !mem_page_dirty(page))) {
+            continue;
+        }
+        if (fwrite(&page, sizeof(page), 1, image) != 1 ||
+            fwrite(mem_map.read[page], MEM_PAGE_SIZE, 1, image) != 1) {
+            return false;
+        }
+    }
+    if (fwrite(&end, sizeof(end), 1, image) != 1) {
+        return false;
+    }
+    if (!delta) {
+        memset(mem_dirty, 0, sizeof(mem_dirty));
+    }
+    return true;
+}
 
-    return fwrite(&mem, sizeof(mem), 1, image) == 1 &&
-           fwrite(mem.flash.block, SIZE_FLASH, 1, image) == 1 &&
-           fwrite(mem.ram.block, SIZE_RAM, 1, image) == 1;
+/* A delta only replaces the pages it holds, so every page written since the base has to be among them */
+static bool mem_delta_covers_dirty(FILE *image) {
+    uint8_t pages[MEM_NUM_PAGES / 8] = { 0 };
+    long start = ftell(image);
+    bool ret = start >= 0;
+    uint16_t page;
+    unsigned int i;
+
+    while (ret && (ret = fread(&page, sizeof(page), 1, image) == 1) && page != MEM_IMAGE_END) {
+        ret = page < MEM_NUM_PAGES && !fseek(image, MEM_PAGE_SIZE, SEEK_CUR);
+        if (ret) {
+            pages[page >> 3] |= 1 << (page & 7);
+        }
+    }
+    for (i = 0; ret && i < sizeof(pages); i++) {
+        ret = !(mem_dirty[i] & ~pages[i]);
+    }
+    return !fseek(image, start, SEEK_SET) && ret;
 }
 
-bool mem_restore(FILE *image) {
+bool mem_restore(FILE *image, bool delta) {
     bool ret = false;
-    unsigned int i;
     uint8_t *tmp_flash_ptr;
     uint8_t *tmp_ram_ptr;
+    uint8_t *tmp_sram_ptr;
+    uint64_t base;
+    uint16_t page;
 
     assert(mem.flash.block);
     assert(mem.ram.block);
+    assert(mem.sram.block);
 
     tmp_flash_ptr = mem.flash.block;
     tmp_ram_ptr = mem.ram.block;
+    tmp_sram_ptr = mem.sram.block;
 
-    ret |= fread(&mem, sizeof(mem), 1, image) == 1;
+    ret = fread(&mem, sizeof(mem), 1, image) == 1 &&
+          fread(&base, sizeof(base), 1, image) == 1;
 
     mem.flash.block = tmp_flash_ptr;
     mem.ram.block = tmp_ram_ptr;
+    mem.sram.block = tmp_sram_ptr;
 
-    ret |= fread(mem.flash.block, SIZE_FLASH, 1, image) == 1 &&
-           fread(mem.ram.block, SIZE_RAM, 1, image) == 1;
-
-    for (i = 0; i < 8; i++) {
-        mem.flash.sector[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_8K];
+    if (ret && delta && base != mem_base) {
+        printf("[eZ80-Emu] Delta image doesn't match the base image.\n");
+        ret = false;
     }
-    for (i = 0; i < 64; i++) {
-        mem.flash.sector[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_64K];
+    if (ret && delta && !mem_delta_covers_dirty(image)) {
+        printf("[eZ80-Emu] Memory changed since the delta was saved, load its base image first.\n");
+        ret = false;
     }
+    if (ret && !delta) {
+        mem_base = base;
+        memset(mem_dirty, 0, sizeof(mem_dirty));
+    }
+    while (ret && (ret = fread(&page, sizeof(page), 1, image) == 1) && page != MEM_IMAGE_END) {
+        ret = page < MEM_NUM_PAGES && mem_map.read[page] &&
+              fread(mem_map.read[page], MEM_PAGE_SIZE, 1, image) == 1;
+        if (ret && delta) {
+            mem_page_touch(page);
+        }
+    }
+
+    mem_flash_sectors();
+    cpu_decode_flush();
 
     return ret;
 }
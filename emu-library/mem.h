@@ -8,14 +8,26 @@ extern "C" {
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "defines.h"
 
-#define SIZE_RAM              0x65800
-#define SIZE_FLASH            0x400000
+#define SIZE_RAM              0x80000     /* external RAM on CS0 */
+#define SIZE_SRAM             0x2000      /* eZ80F92 on-chip SRAM */
+#define SIZE_FLASH            0x20000     /* eZ80F92 on-chip flash */
 #define SIZE_FLASH_SECTOR_8K  0x2000
 #define SIZE_FLASH_SECTOR_64K 0x10000
-#define NUM_SECTORS 64
+#define NUM_SECTORS (SIZE_FLASH / SIZE_FLASH_SECTOR_64K)
 #define NUM_8K_SECTORS 8
 
+/* Agon Light memory map, the rest of the 24-bit space is unmapped */
+#define MEM_FLASH_BASE        0x000000
+#define MEM_RAM_BASE          0x040000
+#define MEM_SRAM_BASE         0xB7E000
+
+#define MEM_PAGE_SHIFT        12
+#define MEM_PAGE_SIZE         (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK         (MEM_PAGE_SIZE - 1)
+#define MEM_NUM_PAGES         (0x1000000 >> MEM_PAGE_SHIFT)
+
 enum flash_commands {
     FLASH_NO_COMMAND,
     FLASH_SECTOR_ERASE,
@@ -45,7 +57,7 @@ typedef struct {
     uint8_t write;
     uint8_t read;
     flash_sector_state_t sector8k[8];
-    flash_sector_state_t sector[64];
+    flash_sector_state_t sector[NUM_SECTORS];
     uint8_t *block;
 
     /* internal */
@@ -57,10 +69,16 @@ typedef struct {
     uint8_t *block;
 } ram_chip_t;
 
+/* Slow path for pages without a host pointer, same convention as the port handlers */
+typedef uint8_t (*mem_read_handler_t)(uint32_t addr, bool peek);
+typedef void (*mem_write_handler_t)(uint32_t addr, uint8_t value, bool poke);
+
 typedef struct mem_state {
     flash_chip_t flash;
     ram_chip_t ram;
-    uint8_t fetch : 4, buffer[1 << 4];
+    ram_chip_t sram;
+    uint8_t unlock;                   /* bytes of the flash unlock sequence fetched so far */
+    uint32_t writes;                  /* bumped whenever RAM contents change */
 } mem_state_t;
 
 extern mem_state_t mem;
@@ -68,10 +86,20 @@ extern mem_state_t mem;
 void mem_init(void);
 void mem_free(void);
 void mem_reset(void);
-bool mem_restore(FILE *image);
-bool mem_save(FILE *image);
+bool mem_restore(FILE *image, bool delta);
+bool mem_save(FILE *image, bool delta);
+bool mem_map_flash(const char *path);
+bool mem_map_ram(const char *path);
+bool mem_unshare(void);
+
+void mem_remap(void);
+void mem_dirty_range(uint32_t addr, uint32_t size);
+void mem_map_memory(uint32_t base, uint32_t size, uint8_t *host, bool writable);
+void mem_map_handlers(uint32_t base, uint32_t size, mem_read_handler_t read, mem_write_handler_t write);
 
 void *phys_mem_ptr(uint32_t addr, int32_t size);
+const uint8_t *mem_fetch_ptr(uint32_t addr, uint32_t size);
+uint8_t *mem_cpu_ptr(uint32_t addr, uint32_t size);
 void *virt_mem_cpy(void *buf, uint32_t addr, int32_t size);
 void *virt_mem_dup(uint32_t addr, int32_t size);
 void *mem_dma_cpy(void *buf, uint32_t addr, int32_t size);
@@ -89,6 +117,17 @@ uint8_t mem_read_unmapped_other(bool update);
 
 /* Don NOT use (Mateo)! Use the above ones. */
 uint8_t mem_read_cpu(uint32_t address, bool fetch);
+
+/* Flash unlock sequence detection, advanced by one transition per fetched byte */
+#define FLASH_UNLOCK_LENGTH 17
+extern uint8_t flash_unlock_next[FLASH_UNLOCK_LENGTH + 1][256];
+void mem_flash_unlock(uint32_t address);
+
+static inline void mem_fetch_track(uint32_t address, uint8_t value) {
+    if (unlikely((mem.unlock = flash_unlock_next[mem.unlock][value]) == FLASH_UNLOCK_LENGTH)) {
+        mem_flash_unlock(address);
+    }
+}
 void mem_write_cpu(uint32_t address, uint8_t value);
 
 #ifdef __cplusplus
@@ -66,6 +66,58 @@ FILE *fopen_utf8(const char *filename, const char *mode) {
     return fopen(filename, mode);
 }
 
+uint64_t os_time_ns(void) {
+    return (uint64_t)(emscripten_get_now() * 1e6);
+}
+
+void os_sleep_ns(uint64_t ns) {
+    (void)ns; /* the browser main loop does the pacing */
+}
+
+void *os_alloc_pages(size_t size) {
+    return calloc(size, 1);
+}
+
+void os_free_pages(void *ptr, size_t size) {
+    (void)size;
+    free(ptr);
+}
+
+void *os_map_file(const char *path, size_t size, bool *created) {
+    (void)path;
+    (void)size;
+    (void)created;
+    return NULL;
+}
+
+void os_unmap_file(void *ptr, size_t size) {
+    (void)ptr;
+    (void)size;
+}
+
+int os_fork(void) {
+    return -1;
+}
+
+int os_wait_child(int child) {
+    (void)child;
+    return -1;
+}
+
+void *os_thread_start(void (*proc)(void *), void *arg) {
+    (void)proc;
+    (void)arg;
+    return NULL;
+}
+
+void os_thread_join(void *thread) {
+    (void)thread;
+}
+
+uint64_t os_peak_rss(void) {
+    return 0;
+}
+
 void EMSCRIPTEN_KEEPALIVE set_file_to_send(const char* path) {
     strcpy(file_buf, path);
 }
@@ -1,7 +1,134 @@
 #include "os.h"
 #include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 FILE *fopen_utf8(const char *filename, const char *mode)
 {
     return fopen(filename, mode);
 }
+
+uint64_t os_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void os_sleep_ns(uint64_t ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000u;
+    ts.tv_nsec = ns % 1000000000u;
+    nanosleep(&ts, NULL);
+}
+
+void *os_alloc_pages(size_t size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void os_free_pages(void *ptr, size_t size)
+{
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
+
+void *os_map_file(const char *path, size_t size, bool *created)
+{
+    struct stat st;
+    void *ptr;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    /* only a new or empty file is sized and seeded, anything else has to be the right size already */
+    if (fstat(fd, &st) || (st.st_size && (size_t)st.st_size != size) ||
+        ((*created = !st.st_size) && ftruncate(fd, (off_t)size))) {
+        close(fd);
+        return NULL;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void os_unmap_file(void *ptr, size_t size)
+{
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
+
+int os_fork(void)
+{
+    return (int)fork();
+}
+
+int os_wait_child(int child)
+{
+    int status;
+    while (waitpid((pid_t)child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+typedef struct {
+    pthread_t thread;
+    void (*proc)(void *);
+    void *arg;
+} os_thread_t;
+
+static void *os_thread_entry(void *thread)
+{
+    ((os_thread_t *)thread)->proc(((os_thread_t *)thread)->arg);
+    return NULL;
+}
+
+void *os_thread_start(void (*proc)(void *), void *arg)
+{
+    os_thread_t *thread = malloc(sizeof(os_thread_t));
+    if (!thread) {
+        return NULL;
+    }
+    thread->proc = proc;
+    thread->arg = arg;
+    if (pthread_create(&thread->thread, NULL, os_thread_entry, thread)) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void os_thread_join(void *thread)
+{
+    if (thread) {
+        pthread_join(((os_thread_t *)thread)->thread, NULL);
+        free(thread);
+    }
+}
+
+uint64_t os_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024u;
+#endif
+}
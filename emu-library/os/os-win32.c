@@ -2,6 +2,8 @@
 #include "os.h"
 #include <stdio.h>
 #include <windows.h>
+#define PSAPI_VERSION 2
+#include <psapi.h>
 
 FILE *fopen_utf8(const char *filename, const char *mode)
 {
@@ -12,4 +14,125 @@ FILE *fopen_utf8(const char *filename, const char *mode)
     return _wfopen(filename_w, mode_w);
 }
 
+uint64_t os_time_ns(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000u +
+           (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000u / (uint64_t)freq.QuadPart;
+}
+
+void os_sleep_ns(uint64_t ns)
+{
+    Sleep((DWORD)(ns / 1000000u));
+}
+
+void *os_alloc_pages(size_t size)
+{
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void os_free_pages(void *ptr, size_t size)
+{
+    (void)size;
+    if (ptr) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+}
+
+void *os_map_file(const char *path, size_t size, bool *created)
+{
+    wchar_t path_w[MAX_PATH];
+    LARGE_INTEGER length;
+    HANDLE file, mapping;
+    void *ptr = NULL;
+
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, path_w, MAX_PATH);
+    file = CreateFileW(path_w, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    /* only a new or empty file is sized and seeded, anything else has to be the right size already */
+    if (GetFileSizeEx(file, &length) && (!length.QuadPart || (uint64_t)length.QuadPart == size)) {
+        *created = !length.QuadPart;
+        length.QuadPart = (LONGLONG)size;
+        if (!*created || (SetFilePointerEx(file, length, NULL, FILE_BEGIN) && SetEndOfFile(file))) {
+            if ((mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, 0, (DWORD)size, NULL))) {
+                ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+                CloseHandle(mapping);
+            }
+        }
+    }
+    CloseHandle(file);
+    return ptr;
+}
+
+void os_unmap_file(void *ptr, size_t size)
+{
+    (void)size;
+    if (ptr) {
+        UnmapViewOfFile(ptr);
+    }
+}
+
+int os_fork(void)
+{
+    return -1;
+}
+
+int os_wait_child(int child)
+{
+    (void)child;
+    return -1;
+}
+
+typedef struct {
+    HANDLE handle;
+    void (*proc)(void *);
+    void *arg;
+} os_thread_t;
+
+static DWORD WINAPI os_thread_entry(LPVOID thread)
+{
+    ((os_thread_t *)thread)->proc(((os_thread_t *)thread)->arg);
+    return 0;
+}
+
+void *os_thread_start(void (*proc)(void *), void *arg)
+{
+    os_thread_t *thread = malloc(sizeof(os_thread_t));
+    if (!thread) {
+        return NULL;
+    }
+    thread->proc = proc;
+    thread->arg = arg;
+    if (!(thread->handle = CreateThread(NULL, 0, os_thread_entry, thread, 0, NULL))) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void os_thread_join(void *thread)
+{
+    if (thread) {
+        WaitForSingleObject(((os_thread_t *)thread)->handle, INFINITE);
+        CloseHandle(((os_thread_t *)thread)->handle);
+        free(thread);
+    }
+}
+
+uint64_t os_peak_rss(void)
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (uint64_t)counters.PeakWorkingSetSize;
+}
+
 #endif
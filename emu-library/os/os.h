@@ -7,11 +7,38 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 
 /* Some really crappy APIs don't use UTF-8 in fopen. */
 FILE *fopen_utf8(const char *filename, const char *mode);
 
+/* Monotonic host time in nanoseconds, and a sleep to pace emulation against it. */
+uint64_t os_time_ns(void);
+void os_sleep_ns(uint64_t ns);
+
+/* Zero filled memory that is only committed when first touched, for guest memory that is mostly never used. */
+void *os_alloc_pages(size_t size);
+void os_free_pages(void *ptr, size_t size);
+
+/* Map size bytes of a host file shared and writable so stores land in the file, NULL if unsupported.
+ * A new or empty file is extended to size bytes and *created is set, any other size fails (NULL). */
+void *os_map_file(const char *path, size_t size, bool *created);
+void os_unmap_file(void *ptr, size_t size);
+
+/* Fork the process, anonymous pages are shared copy on write until either side writes them.
+ * Returns 0 in the child, the child's id in the parent and -1 if unsupported. Only the calling
+ * thread exists in the child. os_wait_child returns the exit status of the child, -1 on failure. */
+int os_fork(void);
+int os_wait_child(int child);
+
+/* Run proc(arg) on a new thread, NULL if threads are unsupported. os_thread_join waits for it to return. */
+void *os_thread_start(void (*proc)(void *), void *arg);
+void os_thread_join(void *thread);
+
+/* Peak resident set size of the process in bytes, 0 if the platform can't tell. */
+uint64_t os_peak_rss(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,13 +9,27 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+#define PORT_COUNT          0x10000
+#define PORT_DEFAULT_CYCLES 2           /* wait states of an internal I/O access */
+
+/* Handlers a device hands to plug_devices */
 typedef struct eZ80portrange {
     uint8_t (*read)(uint16_t, bool);
     void (*write)(uint16_t, uint8_t, bool);
 } eZ80portrange_t;
 
-//extern eZ80portrange_t port_map[0x10];
-extern eZ80portrange_t port_map[0xFF];		// JH
+/* One entry per 16-bit I/O address, unmapped ones point at a handler that ignores the access */
+typedef struct eZ80port {
+    uint8_t (*read)(uint16_t, bool);
+    void (*write)(uint16_t, uint8_t, bool);
+    uint8_t readCycles;
+    uint8_t writeCycles;
+} eZ80port_t;
+
+extern eZ80port_t port_map[PORT_COUNT];
+
+void port_map_clear(void);
+void port_map_range(uint16_t first, uint16_t last, eZ80portrange_t device, uint8_t readCycles, uint8_t writeCycles);
 
 uint8_t port_peek_byte(uint16_t addr);
 uint8_t port_read_byte(uint16_t addr);
@@ -0,0 +1,414 @@
+#include "profile.h"
+#include "cpu.h"
+#include "mem.h"
+#include "schedule.h"
+#include "os/os.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define PROFILE_MAX_DEPTH   16      /* frames kept per sample, leaf included */
+#define PROFILE_STACK_SCAN  64      /* stack slots searched for return addresses */
+#define PROFILE_MIN_STACKS  1024    /* initial size of the stack table, power of two */
+
+typedef struct {
+    uint32_t address;
+    char *name;
+} profile_symbol_t;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t count;                         /* 0 marks a free slot */
+    uint32_t depth;
+    uint32_t frames[PROFILE_MAX_DEPTH];     /* leaf first, then return addresses */
+} profile_stack_t;
+
+typedef struct {
+    uint32_t function;
+    uint64_t self;
+    uint64_t total;
+} profile_entry_t;
+
+static struct {
+    bool active;
+    uint32_t interval;
+    uint64_t samples;
+    profile_stack_t *stacks;                /* open addressing on the frame hash */
+    uint32_t stackMask;
+    uint32_t stackCount;
+    profile_symbol_t *symbols;              /* sorted by address */
+    uint32_t symbolCount;
+} profile;
+
+static uint8_t profile_byte(uint32_t address) {
+    return mem_peek_byte(address);
+}
+
+/* A return address is only believed if a CALL, CALL cc or RST sits right before it */
+static bool profile_is_return(uint32_t address, bool mode) {
+    uint8_t opcode = profile_byte(cpu_address_mode(address - 1, mode));
+    if ((opcode & 0xC7) == 0xC7) {
+        return true;
+    }
+    opcode = profile_byte(cpu_address_mode(address - (mode ? 4 : 3), mode));
+    return opcode == 0xCD || (opcode & 0xC7) == 0xC4;
+}
+
+static uint32_t profile_hash(const uint32_t *frames, uint32_t depth) {
+    uint32_t hash = 2166136261u;
+    uint32_t i;
+    for (i = 0; i < depth; i++) {
+        hash = (hash ^ frames[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static profile_stack_t *profile_slot(profile_stack_t *stacks, uint32_t mask, uint32_t hash,
+                                     const uint32_t *frames, uint32_t depth) {
+    uint32_t i = hash & mask;
+    while (stacks[i].count && (stacks[i].hash != hash || stacks[i].depth != depth ||
+                               memcmp(stacks[i].frames, frames, depth * sizeof *frames))) {
+        i = (i + 1) & mask;
+    }
+    return &stacks[i];
+}
+
+static bool profile_grow(void) {
+    uint32_t size = profile.stacks ? (profile.stackMask + 1) * 2 : PROFILE_MIN_STACKS;
+    profile_stack_t *stacks = calloc(size, sizeof *stacks);
+    uint32_t i;
+
+    if (!stacks) {
+        return false;
+    }
+    if (profile.stacks) {
+        for (i = 0; i <= profile.stackMask; i++) {
+            profile_stack_t *stack = &profile.stacks[i];
+            if (stack->count) {
+                *profile_slot(stacks, size - 1, stack->hash, stack->frames, stack->depth) = *stack;
+            }
+        }
+        free(profile.stacks);
+    }
+    profile.stacks = stacks;
+    profile.stackMask = size - 1;
+    return true;
+}
+
+static void profile_sample(void) {
+    bool mode = cpu.ADL;
+    uint32_t frames[PROFILE_MAX_DEPTH];
+    uint32_t depth = 0, sp, i;
+    uint32_t hash;
+    profile_stack_t *stack;
+
+    frames[depth++] = cpu.registers.PC;
+    sp = cpu.registers.stack[mode].hl;
+    for (i = 0; i < PROFILE_STACK_SCAN && depth < PROFILE_MAX_DEPTH; i++, sp += mode ? 3 : 2) {
+        uint32_t address = cpu_address_mode(sp, mode);
+        uint32_t value = profile_byte(address) | profile_byte(address + 1) << 8;
+        if (mode) {
+            value |= (uint32_t)profile_byte(address + 2) << 16;
+        }
+        if (profile_is_return(value, mode)) {
+            frames[depth++] = cpu_address_mode(value, mode);
+        }
+    }
+
+    /* keep the table at most half full */
+    if ((profile.stackCount + 1) * 2 > (profile.stacks ? profile.stackMask + 1 : 0) && !profile_grow()) {
+        return;
+    }
+    hash = profile_hash(frames, depth);
+    stack = profile_slot(profile.stacks, profile.stackMask, hash, frames, depth);
+    if (!stack->count) {
+        stack->hash = hash;
+        stack->depth = depth;
+        memcpy(stack->frames, frames, depth * sizeof *frames);
+        profile.stackCount++;
+    }
+    stack->count++;
+    profile.samples++;
+}
+
+static void profile_event(enum sched_item_id id) {
+    profile_sample();
+    sched_repeat(id, profile.interval);
+}
+
+void profile_start(uint32_t interval) {
+    profile.interval = interval ? interval : 1;
+    profile.active = true;
+    sched_set(SCHED_PROFILE, profile.interval);
+}
+
+void profile_stop(void) {
+    profile.active = false;
+    sched_clear(SCHED_PROFILE);
+}
+
+void profile_clear(void) {
+    free(profile.stacks);
+    profile.stacks = NULL;
+    profile.stackMask = profile.stackCount = 0;
+    profile.samples = 0;
+}
+
+void profile_reset(void) {
+    sched.items[SCHED_PROFILE].callback.event = profile_event;
+    sched.items[SCHED_PROFILE].clock = CLOCK_CPU;
+    if (profile.active) {
+        sched_set(SCHED_PROFILE, profile.interval);
+    } else {
+        sched_clear(SCHED_PROFILE);
+    }
+}
+
+/* Accepts C:0001A3, 0x1A3, $1A3, 01A3h and bare hex of at least four digits */
+static bool profile_parse_address(const char *token, uint32_t *address) {
+    size_t length = strlen(token);
+    bool prefixed = true;
+    unsigned long value;
+    char *end;
+
+    if (isalpha((unsigned char)token[0]) && token[1] == ':') {
+        token += 2;
+        length -= 2;
+    } else if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+        token += 2;
+        length -= 2;
+    } else if (token[0] == '$') {
+        token++;
+        length--;
+    } else if (length > 1 && (token[length - 1] == 'h' || token[length - 1] == 'H')) {
+        length--;
+        prefixed = isdigit((unsigned char)token[0]);
+    } else {
+        prefixed = false;
+    }
+    if (!length || !isxdigit((unsigned char)token[0]) ||
+        (!prefixed && (length < 4 || !isdigit((unsigned char)token[0])))) {
+        return false;
+    }
+    value = strtoul(token, &end, 16);
+    if ((size_t)(end - token) != length || value > 0xFFFFFF) {
+        return false;
+    }
+    *address = (uint32_t)value;
+    return true;
+}
+
+/* Single letters are skipped so nm style type columns aren't taken for names */
+static bool profile_is_name(const char *token) {
+    const char *c;
+    if (!(isalpha((unsigned char)token[0]) || token[0] == '_' || token[0] == '.') || !token[1]) {
+        return false;
+    }
+    for (c = token; *c; c++) {
+        if (!(isalnum((unsigned char)*c) || *c == '_' || *c == '.' || *c == '$')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int profile_symbol_cmp(const void *a, const void *b) {
+    const profile_symbol_t *x = a, *y = b;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+static void profile_free_symbols(void) {
+    uint32_t i;
+    for (i = 0; i < profile.symbolCount; i++) {
+        free(profile.symbols[i].name);
+    }
+    free(profile.symbols);
+    profile.symbols = NULL;
+    profile.symbolCount = 0;
+}
+
+/* Takes the first name and the first address on each line, anything else is ignored */
+bool profile_load_symbols(const char *path) {
+    FILE *file = fopen_utf8(path, "r");
+    profile_symbol_t *symbols;
+    uint32_t capacity = 0, i, j;
+    char line[512];
+
+    if (!file) {
+        return false;
+    }
+    profile_free_symbols();
+
+    while (fgets(line, sizeof line, file)) {
+        const char *name = NULL;
+        uint32_t address = 0;
+        bool found = false;
+        char *token;
+
+        for (token = strtok(line, " \t\r\n,=()"); token; token = strtok(NULL, " \t\r\n,=()")) {
+            if (!found && profile_parse_address(token, &address)) {
+                found = true;
+            } else if (!name && profile_is_name(token)) {
+                name = token;
+            }
+        }
+        if (!found || !name) {
+            continue;
+        }
+        if (profile.symbolCount == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            if (!(symbols = realloc(profile.symbols, capacity * sizeof *symbols))) {
+                break;
+            }
+            profile.symbols = symbols;
+        }
+        if (!(profile.symbols[profile.symbolCount].name = malloc(strlen(name) + 1))) {
+            break;
+        }
+        strcpy(profile.symbols[profile.symbolCount].name, name);
+        profile.symbols[profile.symbolCount++].address = address;
+    }
+    fclose(file);
+
+    qsort(profile.symbols, profile.symbolCount, sizeof *profile.symbols, profile_symbol_cmp);
+
+    /* keep the first name seen for an address */
+    for (i = j = 0; i < profile.symbolCount; i++) {
+        if (j && profile.symbols[j - 1].address == profile.symbols[i].address) {
+            free(profile.symbols[i].name);
+        } else {
+            profile.symbols[j++] = profile.symbols[i];
+        }
+    }
+    profile.symbolCount = j;
+
+    printf("[eZ80-Emu] Loaded %u symbols from %s\n", profile.symbolCount, path);
+    return profile.symbolCount != 0;
+}
+
+/* Nearest symbol at or below address, NULL if there is none */
+static const profile_symbol_t *profile_symbol(uint32_t address) {
+    uint32_t low = 0, high = profile.symbolCount;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (profile.symbols[middle].address <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low ? &profile.symbols[low - 1] : NULL;
+}
+
+static uint32_t profile_function(uint32_t address) {
+    const profile_symbol_t *symbol = profile_symbol(address);
+    return symbol ? symbol->address : address;
+}
+
+static const char *profile_name(uint32_t address, char *buffer) {
+    const profile_symbol_t *symbol = profile_symbol(address);
+    if (symbol) {
+        return symbol->name;
+    }
+    sprintf(buffer, "0x%06X", address);
+    return buffer;
+}
+
+static int profile_entry_function_cmp(const void *a, const void *b) {
+    const profile_entry_t *x = a, *y = b;
+    return x->function < y->function ? -1 : x->function > y->function;
+}
+
+static int profile_entry_self_cmp(const void *a, const void *b) {
+    const profile_entry_t *x = a, *y = b;
+    if (x->self != y->self) {
+        return x->self < y->self ? 1 : -1;
+    }
+    if (x->total != y->total) {
+        return x->total < y->total ? 1 : -1;
+    }
+    return profile_entry_function_cmp(a, b);
+}
+
+bool profile_save_flat(FILE *file) {
+    profile_entry_t *entries;
+    uint32_t count = 0, merged, i, j, k;
+    char buffer[16];
+    bool success;
+
+    if (!file) {
+        return false;
+    }
+    if (!(entries = malloc(((size_t)profile.stackCount * PROFILE_MAX_DEPTH + 1) * sizeof *entries))) {
+        return false;
+    }
+
+    for (i = 0; profile.stacks && i <= profile.stackMask; i++) {
+        const profile_stack_t *stack = &profile.stacks[i];
+        uint32_t first = count;
+        if (!stack->count) {
+            continue;
+        }
+        for (j = 0; j < stack->depth; j++) {
+            uint32_t function = profile_function(stack->frames[j]);
+            /* recursion only counts once towards total */
+            for (k = first; k < count && entries[k].function != function; k++);
+            if (k == count) {
+                entries[count].function = function;
+                entries[count].self = j ? 0 : stack->count;
+                entries[count++].total = stack->count;
+            }
+        }
+    }
+
+    qsort(entries, count, sizeof *entries, profile_entry_function_cmp);
+    for (i = merged = 0; i < count; i++) {
+        if (merged && entries[merged - 1].function == entries[i].function) {
+            entries[merged - 1].self += entries[i].self;
+            entries[merged - 1].total += entries[i].total;
+        } else {
+            entries[merged++] = entries[i];
+        }
+    }
+    qsort(entries, merged, sizeof *entries, profile_entry_self_cmp);
+
+    success = fprintf(file, "# %llu samples, one every %u cpu cycles\n",
+                      (unsigned long long)profile.samples, profile.interval) > 0 &&
+              fprintf(file, "#   self%%       self   total%%      total  function\n") > 0;
+    for (i = 0; success && i < merged; i++) {
+        double scale = profile.samples ? 100.0 / profile.samples : 0.0;
+        success = fprintf(file, "%7.2f%% %10llu %7.2f%% %10llu  %s\n",
+                          entries[i].self * scale, (unsigned long long)entries[i].self,
+                          entries[i].total * scale, (unsigned long long)entries[i].total,
+                          profile_name(entries[i].function, buffer)) > 0;
+    }
+
+    free(entries);
+    return success;
+}
+
+/* Outermost frame first, as expected by flamegraph.pl which also merges repeated lines */
+bool profile_save_folded(FILE *file) {
+    char buffer[16];
+    uint32_t i, j;
+
+    if (!file) {
+        return false;
+    }
+    for (i = 0; profile.stacks && i <= profile.stackMask; i++) {
+        const profile_stack_t *stack = &profile.stacks[i];
+        if (!stack->count) {
+            continue;
+        }
+        for (j = stack->depth; j--;) {
+            if (fprintf(file, "%s%c", profile_name(stack->frames[j], buffer), j ? ';' : ' ') < 0) {
+                return false;
+            }
+        }
+        if (fprintf(file, "%u\n", stack->count) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
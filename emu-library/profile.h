@@ -0,0 +1,26 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Sampling profiler: the scheduler samples PC (and the return addresses found on the stack) every
+ * interval cpu cycles, so it costs nothing per instruction and doesn't disturb the emulation. */
+void profile_start(uint32_t interval);          /* start sampling every interval cpu cycles */
+void profile_stop(void);                        /* stop sampling, samples are kept */
+void profile_clear(void);                       /* drop all samples */
+void profile_reset(void);                       /* reset proc, rearms sampling after the scheduler reset */
+bool profile_load_symbols(const char *path);    /* load a .map or symbol file to name addresses */
+bool profile_save_flat(FILE *file);             /* self and total samples per function, hottest first */
+bool profile_save_folded(FILE *file);           /* folded stacks for flamegraph.pl */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,19 +17,23 @@ enum sched_item_id {
 
     SCHED_RUN,
     SCHED_WATCHDOG,
-    SCHED_TIMER_DELAY, /* Must be before TIMER# */
-    SCHED_TIMER1,
-    SCHED_TIMER2,
-    SCHED_TIMER3,
-    SCHED_OSTIMER,
+    SCHED_PRT0,
+    SCHED_PRT1,
+    SCHED_PRT2,
+    SCHED_PRT3,
+    SCHED_PRT4,
+    SCHED_PRT5,
     SCHED_KEYPAD,
     SCHED_LCD,
     SCHED_RTC,
     SCHED_USB,
     SCHED_USB_DEVICE,
+    SCHED_UART0_RX,
+    SCHED_UART0_TX,
+    SCHED_PROFILE,
 
     SCHED_FIRST_EVENT = SCHED_RUN,
-    SCHED_LAST_EVENT = SCHED_USB_DEVICE,
+    SCHED_LAST_EVENT = SCHED_PROFILE,
 
     SCHED_PREV_MA,
 
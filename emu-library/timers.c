@@ -1,239 +1,174 @@
 #include "timers.h"
-#include "control.h"
 #include "cpu.h"
-#include "emu.h"
 #include "schedule.h"
 #include "interrupt.h"
 
-#include <assert.h>
-#include <stdio.h>
 #include <string.h>
+#include <stdio.h>
 
-/* JH - Documentation for TI84 timers:
-https://wikiti.brandonw.net/index.php?title=84PCE:Ports:7000
-
-3 32-bit timers, mem-mapped to $7000 - $7038
-
-$7000       Timer 1 counter (R/W)
-$7004       Timer 1 reset (reload) value
-$7008       Timer 1 Match value 1
-$700C       Timer 1 Match value 2
-$7010 - $701F   Timer 2
-$7020 - $702F   Timer 3
-$7030       Control register (12-bit, 4 bits for each timer)
-            Bit 0 - timer 1 enable
-            Bit 1 - timer 1 clock source (32768 Hz xtal, or CPU clock)
-            Bit 2 - timer 1 interrupt enable (when counter hits 0)
-            Bit 9 - timer 1 Count direction (up or down)
-            Bits 3, 4, 5, 10 - timer 2  
-            Bits 6, 7, 8, 11 - timer 3  
-$7034       Intrrrupt status for all 3 timers (12 bits, 3 bits per timer)
-$7038       Interrupt mask (as per interrupt status)
-$7038 (3C?) (read)    Revision number
-*/
-
-
-
-/* Global GPT state */
-general_timers_state_t gpt;
-
-static void ost_event(enum sched_item_id id) {
-    static const int ost_ticks[4] = { 73, 153, 217, 313 };
-    intrpt_set(INT_OSTIMER, gpt.osTimerState);
-    sched_repeat(id, gpt.osTimerState ? 1 : ost_ticks[control.ports[0] & 3]);
-    gpt.osTimerState = !gpt.osTimerState;
+/*
+ * eZ80F92 programmable reload timers, ps0153 chapter "Programmable Reload Timers"
+ *
+ * $80 + 3n     TMRn_CTL    control, reading clears PRT_IRQ
+ * $81 + 3n     TMRn_DR_L   count low byte (read), latches the high byte / TMRn_RR_L reload low byte (write)
+ * $82 + 3n     TMRn_DR_H   latched count high byte (read) / TMRn_RR_H reload high byte (write)
+ * $92          TMR_ISS     input source select, stored only: every timer counts the system clock
+ *
+ * The count is never stepped. A running timer has its scheduler item set to the cycle it reaches
+ * the end of count, and the count seen by a read is worked out from the cycles remaining until then,
+ * so a periodic tick costs one event per period and nothing in between.
+ */
+
+#define PRT_CTL_EN          0x01
+#define PRT_CTL_RST_EN      0x02    /* reload and restart */
+#define PRT_CTL_DIV         0x0C
+#define PRT_CTL_CONTINUOUS  0x10
+#define PRT_CTL_IRQ_EN      0x40
+#define PRT_CTL_IRQ         0x80
+#define PRT_CTL_MASK        0x5F
+
+#define PRT_BASE            0x80
+#define PRT_ISS             0x92
+
+prt_state_t prt;
+
+static uint32_t prt_divider(const prt_timer_state_t *timer) {
+    return 4u << ((timer->control & PRT_CTL_DIV) >> 1);
 }
 
-static uint32_t gpt_peek_counter(int index) {
-    enum sched_item_id id = SCHED_TIMER1 + index;
-    timer_state_t *timer = &gpt.timer[index];
-    uint32_t invert = (gpt.control >> (9 + index) & 1) ? ~0 : 0;
-    if (!(gpt.control >> (index * 3) & 1) || !sched_active(id)) {
-        return timer->counter;
-    }
-    if (gpt.reset & 1 << index) {
-        gpt.reset &= ~(1 << index);
-        return invert;
-    }
-    return timer->counter + ((sched_ticks_remaining(id) + invert) ^ invert);
+static uint32_t prt_reload(const prt_timer_state_t *timer) {
+    return timer->reload ? timer->reload : 0x10000;
 }
 
-static void gpt_restore_state(enum sched_item_id id) {
-    int index = id - SCHED_TIMER1;
-    gpt.timer[index].counter = gpt_peek_counter(index);
-}
+/* Clock edges left until the end of count, rounded up to whole prescaler periods */
+static uint32_t prt_counter(int index) {
+    enum sched_item_id id = SCHED_PRT0 + index;
+    const prt_timer_state_t *timer = &prt.timer[index];
+    uint32_t divider = prt_divider(timer);
 
-static uint64_t gpt_next_event(enum sched_item_id id) {
-    int index = id - SCHED_TIMER1;
-    struct sched_item *item = &sched.items[id];
-    timer_state_t *timer = &gpt.timer[index];
-    uint64_t delay;
-    gpt.reset &= ~(1 << index);
-    if (gpt.control >> (3*index) & 1) {             // Timer n enabled in control bits
-        int event;
-        uint32_t counter = timer->counter, invert, status = 0, next;
-        invert = (gpt.control >> (9 + index) & 1) ? ~0 : 0;     // -1 if coutning up , 0 if counting down?
-        for (event = 0; event <= 1; event++) {
-            if (counter == timer->match[event]) {
-                status |= 1 << event;                           // Counter hit a match value? Set int status reg
-            }
-        }
-        if (counter == invert) {                                // Counter hit 0 (coutning down), or 0xFFFFFFF (coutnign up)
-            gpt.reset |= 1 << index;
-            if (gpt.control >> (3*index) & 1 << 2) {
-                status |= 1 << 2;                               // Counter expired? Set status "Overflow" bit
-            }
-            counter = timer->reset;                             // Set counter to relaod value
-        } else {
-            counter -= invert | 1;                              // Decrement/increment counter
-        }
-        if (status) {                                                   // Counter hti a match or overflowed/underflowed
-            if (!sched_active(SCHED_TIMER_DELAY)) {
-                sched_repeat_relative(SCHED_TIMER_DELAY, id, 0, 2);     // Add something to the scheduler
-            }
-            delay = sched_cycle(SCHED_TIMER_DELAY) - sched_cycle(id);
-            assert(delay <= 2);
-            gpt.delayStatus |= status << (((2 - delay)*3 + index)*3);       // Set up interrupt after a small delay?
-            gpt.delayIntrpt |= 1 << (3*(4 - delay) + index);
-        }
-        item->clock = (gpt.control >> index*3 & 2) ? CLOCK_32K : CLOCK_CPU;
-        if (gpt.reset & 1 << index) {
-            next = 0;                           // counter had exired above
-            timer->counter = counter;           // Reload counter
-        } else {
-            next = counter ^ invert;
-            timer->counter = invert;
-        }
-        for (event = 1; event >= 0; event--) {                          // Handle timer "match"
-            uint32_t temp = (counter ^ invert) - (timer->match[event] ^ invert);
-            if (temp < next) {
-                next = temp;
-                timer->counter = timer->match[event];
-            }
-        }
-        return (uint64_t)next + 1;
+    if (!sched_active(id)) {
+        return timer->counter;
     }
-    return 0;
+    return (uint32_t)((sched_ticks_remaining(id) + divider - 1) / divider);
 }
 
-static void gpt_refresh(enum sched_item_id id) {
-    sched.items[id].clock = CLOCK_CPU;
-    sched_set(id, 0); /* dummy activate to current cycle */
-    uint64_t next_event = gpt_next_event(id);
-    if (next_event) {
-        sched_set(id, next_event);
-    } else {
-        sched_clear(id);
-    }
+static void prt_intrpt(int index) {
+    uint8_t control = prt.timer[index].control;
+    intrpt_set(INT_PRT0 << index, (control & PRT_CTL_IRQ) && (control & PRT_CTL_IRQ_EN));
 }
 
-static void gpt_event(enum sched_item_id id) {
-    sched_repeat(id, 0); /* re-activate to event cycle */
-    uint64_t next_event = gpt_next_event(id);
-    if (next_event) {
-        sched_repeat(id, next_event);
-    } else {
-        sched_clear(id);
-    }
-}
+static void prt_event(enum sched_item_id id) {
+    int index = id - SCHED_PRT0;
+    prt_timer_state_t *timer = &prt.timer[index];
 
-static void gpt_delay(enum sched_item_id id) {
-    gpt.status |= gpt.delayStatus & ((1 << 9) - 1);
-    for (int index = 0; index < 3; index++) {
-        intrpt_set(INT_TIMER1 << index, gpt.delayIntrpt & 1 << index);
-    }
-    gpt.delayStatus >>= 9;
-    if (gpt.delayStatus || gpt.delayIntrpt) {
-        sched_repeat(id, 1);
+    timer->control |= PRT_CTL_IRQ;
+    if (timer->control & PRT_CTL_CONTINUOUS) {
+        timer->counter = prt_reload(timer);
+        sched_repeat(id, (uint64_t)timer->counter * prt_divider(timer));
+    } else {
+        timer->control &= ~PRT_CTL_EN;
+        timer->counter = 0;
     }
-    gpt.delayIntrpt >>= 3;
+    prt_intrpt(index);
 }
 
-// JH - What this seems to do is call the specified function with (SCHED_TIMER1 + which), but if
-//      which = 3, then it call the specified function 3 times, once for each timer
-static void gpt_some(int which, void update(enum sched_item_id id)) {
-    int index = which < 3 ? which : 0;
-    do {
-        update(SCHED_TIMER1 + index);
-    } while (++index < which);
-}
-
-static uint8_t gpt_read(uint16_t address, bool peek) {
-    uint8_t value = 0;
-    (void)peek;
-
-    // All timer registers can be read
+static uint8_t prt_read(const uint16_t pio, bool peek) {
+    uint8_t index = (pio - PRT_BASE) / 3;
+    prt_timer_state_t *timer = &prt.timer[index];
+    uint8_t value;
+    uint32_t counter;
 
-    if (address < 0x30 && (address & 0xC) == 0)
-        {
-        // Get the relevant byte of the relevant 32-bit counter (tied to the scheduler)
-        value = read8(gpt_peek_counter(address >> 4 & 3), (address & 3) << 3);
-        }
-    else if (address < 0x40)
-        {
-        // Just read the relevant byte from the relevant timer register
-        value = ((uint8_t *)&gpt)[address];
-        }
+    if (pio >= PRT_ISS) {
+        return pio == PRT_ISS ? prt.inputSelect : 0;
+    }
 
+    switch ((pio - PRT_BASE) % 3) {
+        case 0:
+            value = timer->control;
+            if (!peek) {
+                timer->control &= ~PRT_CTL_IRQ;
+                prt_intrpt(index);
+            }
+            break;
+        case 1:
+            counter = prt_counter(index);
+            value = counter & 0xFF;
+            if (!peek) {
+                timer->latch = counter >> 8 & 0xFF;
+            }
+            break;
+        default:
+            value = timer->latch;
+            break;
+    }
     return value;
 }
 
-static void gpt_write(uint16_t address, uint8_t value, bool poke) {
+static void prt_write(const uint16_t pio, const uint8_t value, bool poke) {
+    uint8_t index = (pio - PRT_BASE) / 3;
+    enum sched_item_id id = SCHED_PRT0 + index;
+    prt_timer_state_t *timer = &prt.timer[index];
     (void)poke;
 
-    if (address >= 0x34 && address < 0x38)
-        {
-        // Reset interrupt status bits for the 3 timers
-        ((uint8_t *)&gpt)[address] &= ~value;
-        }
-    else if (address < 0x3C)
-        {
-        // Writing to a timer counter? (Interesting adding a bool to an int32!)
-        bool counter_delay = address < 0x30 && (address & 0xC) == 0;
-        cpu.cycles += counter_delay;
-        int timer = address >> 4 & 3;               // which timer (0 to 3, 3 meaning "all")
-        gpt_some(timer, gpt_restore_state);     // calls gpt_restore_state(SCHED_TIMER1 + timer)
-        // NB: Whoever wrtoe this code is a freaking tosser
-        // If we are writing to 0x30, then gpt_some() above updates all 3 timers
-        ((uint8_t *)&gpt)[address] = value;      // update local timer state
-        gpt_some(timer, gpt_refresh);           // calls gpt_refresh(SCHED_TIMER1 + timer)      
-        cpu.cycles -= counter_delay;
+    if (pio >= PRT_ISS) {
+        if (pio == PRT_ISS) {
+            prt.inputSelect = value;
         }
+        return;
+    }
 
+    switch ((pio - PRT_BASE) % 3) {
+        case 0:
+            timer->counter = prt_counter(index);
+            timer->control = (timer->control & PRT_CTL_IRQ) | (value & PRT_CTL_MASK);
+            if ((value & PRT_CTL_RST_EN) || !timer->counter) {
+                timer->counter = prt_reload(timer);
+            }
+            if (value & PRT_CTL_EN) {
+                sched_set(id, (uint64_t)timer->counter * prt_divider(timer));
+            } else {
+                sched_clear(id);
+            }
+            prt_intrpt(index);
+            cpu_restore_next(); /* enabling a pending request takes effect after this instruction */
+            break;
+        case 1:
+            timer->reload = (timer->reload & 0xFF00) | value;
+            break;
+        default:
+            timer->reload = (timer->reload & 0x00FF) | value << 8;
+            break;
+    }
 }
 
-void gpt_reset() {
+void prt_reset(void) {
     enum sched_item_id id;
-    memset(&gpt, 0, sizeof(gpt));
-    gpt.revision = 0x00010801;          // revision 1.8.1
-    // Set up the timers in the scheduling system
-    sched.items[SCHED_TIMER_DELAY].callback.event = gpt_delay;
-    sched.items[SCHED_TIMER_DELAY].clock = CLOCK_CPU;
-    for (id = SCHED_TIMER1; id <= SCHED_TIMER3; id++)
-        {
-        sched.items[id].callback.event = gpt_event;
-        gpt_refresh(id);
-        }
-    sched.items[SCHED_OSTIMER].callback.event = ost_event;          // JH - Don't need this in Agon? (Or use JUST OS timer via Agon timer 2?)
-    sched.items[SCHED_OSTIMER].clock = CLOCK_32K;
-    sched_set(SCHED_OSTIMER, 0);
-    printf("[eZ80-Emu] GPT reset.\n");
+
+    memset(&prt, 0, sizeof(prt));
+    for (id = SCHED_PRT0; id <= SCHED_PRT5; id++) {
+        sched.items[id].callback.event = prt_event;
+        sched.items[id].clock = CLOCK_CPU;
+        sched_clear(id);
+        intrpt_set(INT_PRT0 << (id - SCHED_PRT0), false);
+    }
+
+    printf("[eZ80-Emu] PRT reset.\n");
 }
 
 static const eZ80portrange_t device = {
-    .read  = gpt_read,
-    .write = gpt_write
+    .read  = prt_read,
+    .write = prt_write
 };
 
-eZ80portrange_t init_gpt(void) {
-    printf("[eZ80-Emu] Initialized General Purpose Timers...\n");
+eZ80portrange_t init_prt(void) {
+    printf("[eZ80-Emu] Initialized Programmable Reload Timers...\n");
     return device;
 }
 
-bool gpt_save(FILE *image) {
-    return fwrite(&gpt, sizeof(gpt), 1, image) == 1;
+bool prt_save(FILE *image) {
+    return fwrite(&prt, sizeof(prt), 1, image) == 1;
 }
 
-bool gpt_restore(FILE *image) {
-    return fread(&gpt, sizeof(gpt), 1, image) == 1;
+bool prt_restore(FILE *image) {
+    return fread(&prt, sizeof(prt), 1, image) == 1;
 }
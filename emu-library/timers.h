@@ -10,24 +10,27 @@ extern "C" {
 #include <stdbool.h>
 #include <stdio.h>
 
-typedef struct timer_state {
-    uint32_t counter, reset, match[2];							// 16 bytes
-} timer_state_t;
-
-typedef struct general_timers_state {
-    timer_state_t timer[3];									// 48 bytes (0x00 to 0x2F)
-    uint32_t control, status, mask, revision;				// ctrl =  0x30, status = 0x34, mask = 0x38, revision = 0x3C						
-    uint32_t delayStatus, delayIntrpt;
-    uint8_t reset;
-    bool osTimerState;
-} general_timers_state_t;
-
-extern general_timers_state_t gpt;
-
-eZ80portrange_t init_gpt(void);
-void gpt_reset(void);
-bool gpt_restore(FILE *image);
-bool gpt_save(FILE *image);
+#define PRT_NUM_TIMERS 6
+
+typedef struct prt_timer_state {
+    uint32_t counter;               /* count when last stopped or reloaded, 0x10000 for a reload of 0 */
+    uint16_t reload;
+    uint8_t control;
+    uint8_t latch;                  /* high byte of the count, latched by reading DR_L */
+} prt_timer_state_t;
+
+/* eZ80F92 programmable reload timers 0-5 at ports 0x80-0x91, and the input source select at 0x92 */
+typedef struct prt_state {
+    prt_timer_state_t timer[PRT_NUM_TIMERS];
+    uint8_t inputSelect;
+} prt_state_t;
+
+extern prt_state_t prt;
+
+eZ80portrange_t init_prt(void);
+void prt_reset(void);
+bool prt_restore(FILE *image);
+bool prt_save(FILE *image);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,224 @@
+#include "trace.h"
+#include "port.h"
+#include "schedule.h"
+#include "os/os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * File format, all integers are LEB128 varints unless noted:
+ *   header:  TRACE_MAGIC (7 bytes), TRACE_VERSION (1 byte), cpu clock, cycle the trace started at
+ *   record:  kind (1 byte), cycles since the previous record, zigzag address delta from the previous
+ *            record of the same kind, value (1 byte)
+ * Fetches and stack accesses move by a few bytes at a time so most records take 4 bytes.
+ */
+
+#define TRACE_RING_SIZE  (1 << 18)      /* records, power of two */
+#define TRACE_RING_MASK  (TRACE_RING_SIZE - 1)
+#define TRACE_OUT_SIZE   (1 << 16)      /* encoded bytes written per fwrite */
+#define TRACE_RECORD_MAX 17             /* largest encoded record */
+#define TRACE_IDLE_NS    100000         /* writer sleep when the ring is empty */
+
+/* The ring has a single producer (the emulation) and a single consumer (the writer), each index is
+ * only written by its owner and published with release semantics. */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define trace_load(p)     (_ReadWriteBarrier(), *(volatile uint32_t *)(p))
+#define trace_store(p, v) do { _ReadWriteBarrier(); *(volatile uint32_t *)(p) = (v); } while (0)
+#else
+#define trace_load(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define trace_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+    uint64_t cycle;
+    uint32_t address;
+    uint8_t kind;
+    uint8_t value;
+} trace_entry_t;
+
+static struct {
+    FILE *file;
+    void *thread;
+    trace_entry_t *ring;
+    uint32_t head;                          /* next slot the emulation fills */
+    uint32_t tail;                          /* next slot the writer encodes */
+    uint32_t tailSeen;                      /* emulation side copy of tail */
+    uint32_t stop;
+    bool error;
+    uint64_t records;
+    uint64_t stalls;                        /* times the emulation waited for the writer */
+    uint64_t lastCycle;                     /* encoder state, owned by the writer */
+    uint32_t lastAddress[TRACE_KINDS];
+    uint8_t out[TRACE_OUT_SIZE];
+    uint8_t kinds;                          /* selected kinds, applied while active */
+    uint8_t ignored[PORT_COUNT / 8];  /* ports left out of the trace */
+} trace = { .kinds = TRACE_ALL };
+
+bool trace_active;
+uint8_t trace_kinds;
+
+static uint8_t *trace_varint(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static uint8_t *trace_encode(uint8_t *out, const trace_entry_t *entry) {
+    int32_t delta = (int32_t)(entry->address - trace.lastAddress[entry->kind]);
+    *out++ = entry->kind;
+    out = trace_varint(out, entry->cycle - trace.lastCycle);
+    out = trace_varint(out, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    *out++ = entry->value;
+    trace.lastCycle = entry->cycle;
+    trace.lastAddress[entry->kind] = entry->address;
+    return out;
+}
+
+/* Encode whatever is in the ring, returns false if it was empty */
+static bool trace_drain(void) {
+    uint32_t head = trace_load(&trace.head);
+    uint32_t tail = trace.tail;
+    uint8_t *out = trace.out;
+
+    if (tail == head) {
+        return false;
+    }
+    while (tail != head) {
+        out = trace_encode(out, &trace.ring[tail++ & TRACE_RING_MASK]);
+        if (out > trace.out + TRACE_OUT_SIZE - TRACE_RECORD_MAX || tail == head) {
+            if (fwrite(trace.out, 1, (size_t)(out - trace.out), trace.file) != (size_t)(out - trace.out)) {
+                trace.error = true;
+            }
+            out = trace.out;
+            trace_store(&trace.tail, tail);
+        }
+    }
+    return true;
+}
+
+static void trace_writer(void *arg) {
+    (void)arg;
+    while (!trace_load(&trace.stop)) {
+        if (!trace_drain()) {
+            os_sleep_ns(TRACE_IDLE_NS);
+        }
+    }
+    trace_drain();
+}
+
+void trace_record(trace_kind_t kind, uint32_t address, uint8_t value) {
+    uint32_t head = trace.head;
+    trace_entry_t *entry;
+
+    if (kind >= TRACE_PORT_READ && (trace.ignored[(uint16_t)address >> 3] & (1 << (address & 7)))) {
+        return;
+    }
+    while (head - trace.tailSeen == TRACE_RING_SIZE) {
+        if (!trace.thread) {
+            trace_drain();
+        }
+        if (head - (trace.tailSeen = trace_load(&trace.tail)) == TRACE_RING_SIZE) {
+            trace.stalls++;
+            os_sleep_ns(TRACE_IDLE_NS / 10);
+        }
+    }
+
+    entry = &trace.ring[head & TRACE_RING_MASK];
+    entry->cycle = sched_total_cycles();
+    entry->address = address;
+    entry->kind = (uint8_t)kind;
+    entry->value = value;
+    trace_store(&trace.head, head + 1);
+    trace.records++;
+}
+
+bool trace_start(const char *path) {
+    uint8_t header[8 + 10 + 10], *end;
+
+    if (trace_active || !path) {
+        return false;
+    }
+    if (!(trace.ring = malloc(TRACE_RING_SIZE * sizeof(trace_entry_t)))) {
+        return false;
+    }
+    if (!(trace.file = fopen_utf8(path, "wb"))) {
+        printf("[eZ80-Emu] Couldn't open trace file %s.\n", path);
+        free(trace.ring);
+        trace.ring = NULL;
+        return false;
+    }
+
+    trace.head = trace.tail = trace.tailSeen = trace.stop = 0;
+    trace.error = false;
+    trace.records = trace.stalls = 0;
+    trace.lastCycle = sched_total_cycles();
+    memset(trace.lastAddress, 0, sizeof(trace.lastAddress));
+
+    memcpy(header, TRACE_MAGIC, 7);
+    header[7] = TRACE_VERSION;
+    end = trace_varint(header + 8, sched.clockRates[CLOCK_CPU]);
+    end = trace_varint(end, trace.lastCycle);
+    trace.error = fwrite(header, 1, (size_t)(end - header), trace.file) != (size_t)(end - header);
+
+    /* without threads the ring is drained by the emulation whenever it fills up */
+    trace.thread = os_thread_start(trace_writer, NULL);
+    trace_active = true;
+    trace_kinds = trace.kinds;
+    printf("[eZ80-Emu] Tracing to %s.\n", path);
+    return true;
+}
+
+bool trace_stop(void) {
+    bool ok;
+
+    if (!trace_active) {
+        return false;
+    }
+    trace_active = false;
+    trace_kinds = 0;
+    trace_store(&trace.stop, 1);
+    if (trace.thread) {
+        os_thread_join(trace.thread);
+        trace.thread = NULL;
+    } else {
+        trace_drain();
+    }
+
+    ok = !trace.error && !ferror(trace.file);
+    ok &= fclose(trace.file) == 0;
+    trace.file = NULL;
+    free(trace.ring);
+    trace.ring = NULL;
+
+    printf("[eZ80-Emu] Traced %llu accesses (%llu stalls).\n",
+           (unsigned long long)trace.records, (unsigned long long)trace.stalls);
+    return ok;
+}
+
+void trace_select(uint8_t kinds) {
+    trace.kinds = kinds & TRACE_ALL;
+    if (trace_active) {
+        trace_kinds = trace.kinds;
+    }
+}
+
+void trace_select_ports(uint16_t first, uint16_t last, bool traced) {
+    uint32_t port;
+    for (port = first; port <= last; port++) {
+        if (traced) {
+            trace.ignored[port >> 3] &= ~(1 << (port & 7));
+        } else {
+            trace.ignored[port >> 3] |= 1 << (port & 7);
+        }
+    }
+}
+
+uint64_t trace_records(void) {
+    return trace.records;
+}
@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "defines.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Memory and port access tracer: accesses are queued in a ring that a writer thread drains to a file,
+ * so tracing costs the emulation a store per access instead of formatting output. The file is a header
+ * followed by varint encoded records, see trace.c, and tools/tracestat reads it back. */
+typedef enum {
+    TRACE_MEM_READ,
+    TRACE_MEM_WRITE,
+    TRACE_MEM_FETCH,
+    TRACE_PORT_READ,
+    TRACE_PORT_WRITE,
+    TRACE_KINDS
+} trace_kind_t;
+
+#define TRACE_MAGIC   "eZ80TRC"
+#define TRACE_VERSION 1
+
+#define TRACE_MASK(kind) (1u << (kind))
+#define TRACE_ALL        (TRACE_MASK(TRACE_KINDS) - 1)
+#define TRACE_MEMORY     (TRACE_MASK(TRACE_MEM_READ) | TRACE_MASK(TRACE_MEM_WRITE) | TRACE_MASK(TRACE_MEM_FETCH))
+#define TRACE_PORTS      (TRACE_MASK(TRACE_PORT_READ) | TRACE_MASK(TRACE_PORT_WRITE))
+
+bool trace_start(const char *path);      /* start recording the selected accesses to path */
+bool trace_stop(void);                   /* drain the ring and close the file, false on write errors */
+uint64_t trace_records(void);            /* accesses recorded since trace_start */
+void trace_record(trace_kind_t kind, uint32_t address, uint8_t value);
+
+/* Filters, both can be changed while tracing: which kinds of access are recorded (TRACE_ALL by
+ * default) and which ports the port records are kept for (all of them by default) */
+void trace_select(uint8_t kinds);
+void trace_select_ports(uint16_t first, uint16_t last, bool traced);
+
+extern bool trace_active;
+extern uint8_t trace_kinds;              /* kinds being recorded, 0 when not tracing */
+
+static inline void trace_access(trace_kind_t kind, uint32_t address, uint8_t value) {
+    if (unlikely(trace_kinds & TRACE_MASK(kind))) {
+        trace_record(kind, address, value);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
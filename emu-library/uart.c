@@ -0,0 +1,313 @@
+#include "uart.h"
+#include "cpu.h"
+#include "interrupt.h"
+#include "schedule.h"
+#include "../agon_vdp.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * eZ80F92 UART0 at ports 0xC0-0xC7, connected to the VDP
+ *
+ * Bytes move at the programmed line rate: each one takes a character time (start, data, parity and
+ * stop bits at 16 clocks per bit) and the receive and transmit sides each have a scheduler item
+ * firing at character boundaries. The far end is the VDP's queue, which is only looked at every
+ * UART_RX_POLL character times while the link is idle and is held back while the receive FIFO is
+ * full, so nothing is ever overrun and the line status error bits stay clear.
+ */
+
+#define UART_IER_RIE        0x01    /* receive data ready and character timeout */
+#define UART_IER_TIE        0x02    /* transmit buffer empty */
+#define UART_IER_TCIE       0x10    /* transmission complete */
+#define UART_IER_MASK       0x1F
+
+#define UART_IIR_NONE       0x01
+#define UART_IIR_RDR        0x04
+#define UART_IIR_CTO        0x0C
+#define UART_IIR_TC         0x0A
+#define UART_IIR_TBE        0x02
+#define UART_IIR_FIFO       0xC0
+
+#define UART_FCTL_FIFOEN    0x01
+#define UART_FCTL_CLRRXF    0x02
+#define UART_FCTL_CLRTXF    0x04
+#define UART_FCTL_TRIG      0xC0
+
+#define UART_LCR_CHAR       0x03
+#define UART_LCR_STB        0x04
+#define UART_LCR_PEN        0x08
+#define UART_LCR_DLAB       0x80
+
+#define UART_MCR_LOOP       0x10
+#define UART_MCR_MASK       0x3F
+
+#define UART_LSR_DR         0x01
+#define UART_LSR_THRE       0x20
+#define UART_LSR_TEMT       0x40
+
+#define UART_RX_POLL        16      /* character times between looks at an idle link */
+#define UART_RX_TIMEOUT     4       /* character times before a partly filled FIFO times out */
+
+uart_state_t uart0;
+
+static bool uart_fifo_push(uart_fifo_t *fifo, uint8_t size, uint8_t value) {
+    if (fifo->count >= size) {
+        return false;
+    }
+    fifo->data[(fifo->head + fifo->count++) % UART_FIFO_SIZE] = value;
+    return true;
+}
+
+static uint8_t uart_fifo_pop(uart_fifo_t *fifo) {
+    uint8_t value = fifo->data[fifo->head];
+    if (fifo->count) {
+        fifo->head = (fifo->head + 1) % UART_FIFO_SIZE;
+        fifo->count--;
+    }
+    return value;
+}
+
+static void uart_fifo_clear(uart_fifo_t *fifo) {
+    fifo->head = fifo->count = 0;
+}
+
+/* Without FIFOs each side holds a single byte */
+static uint8_t uart0_fifo_size(void) {
+    return uart0.fctl & UART_FCTL_FIFOEN ? UART_FIFO_SIZE : 1;
+}
+
+static uint8_t uart0_rx_trigger(void) {
+    static const uint8_t levels[4] = { 1, 4, 8, 14 };
+    return uart0.fctl & UART_FCTL_FIFOEN ? levels[uart0.fctl >> 6] : 1;
+}
+
+static uint32_t uart0_char_cycles(void) {
+    uint32_t bits = 1 + 5 + (uart0.lcr & UART_LCR_CHAR) + !!(uart0.lcr & UART_LCR_PEN) + 1 + !!(uart0.lcr & UART_LCR_STB);
+    return bits * 16 * (uart0.brg ? uart0.brg : 1);
+}
+
+/* Highest priority pending source, as read from IIR */
+static uint8_t uart0_iir(void) {
+    uint8_t fifo = uart0.fctl & UART_FCTL_FIFOEN ? UART_IIR_FIFO : 0;
+
+    if (uart0.ier & UART_IER_RIE) {
+        if (uart0.rx.count >= uart0_rx_trigger()) {
+            return fifo | UART_IIR_RDR;
+        }
+        if (uart0.rxTimeout) {
+            return fifo | UART_IIR_CTO;
+        }
+    }
+    if ((uart0.ier & UART_IER_TCIE) && !uart0.tx.count && !uart0.txBusy) {
+        return fifo | UART_IIR_TC;
+    }
+    if ((uart0.ier & UART_IER_TIE) && uart0.txEmptyIntrpt) {
+        return fifo | UART_IIR_TBE;
+    }
+    return fifo | UART_IIR_NONE;
+}
+
+static void uart0_intrpt(void) {
+    intrpt_set(INT_UART0, !(uart0_iir() & UART_IIR_NONE));
+    cpu_restore_next(); /* a request raised by a register access is taken after this instruction */
+}
+
+static void uart0_rx_push(uint8_t value) {
+    uart_fifo_push(&uart0.rx, uart0_fifo_size(), value);
+    uart0.rxIdle = 0;
+    uart0.rxTimeout = false;
+}
+
+/* Nothing is received until the baud rate is programmed, the VDP can't talk to us before that */
+static void uart0_rx_start(void) {
+    if (!sched_active(SCHED_UART0_RX)) {
+        uart0.rxInterval = 1;
+        sched_set(SCHED_UART0_RX, uart0_char_cycles());
+    }
+}
+
+static void uart0_rx_event(enum sched_item_id id) {
+    bool ready = (vdp_read_status_byte() & UART_LSR_DR) && !(uart0.mcr & UART_MCR_LOOP);
+    uint8_t interval = UART_RX_POLL;
+
+    if (ready && uart0.rx.count < uart0_fifo_size()) {
+        uart0_rx_push(vdp_read_serial());
+    } else if (uart0.rxIdle < UART_RX_TIMEOUT) {
+        uart0.rxIdle += uart0.rxInterval;
+        if (uart0.rxIdle >= UART_RX_TIMEOUT) {
+            uart0.rxIdle = UART_RX_TIMEOUT;
+            uart0.rxTimeout = uart0.rx.count && (uart0.fctl & UART_FCTL_FIFOEN);
+        }
+    }
+
+    if (ready) {
+        interval = 1; /* the VDP sends back to back */
+    } else if (uart0.rx.count && (uart0.fctl & UART_FCTL_FIFOEN) && !uart0.rxTimeout) {
+        interval = UART_RX_TIMEOUT - uart0.rxIdle;
+    }
+    uart0.rxInterval = interval;
+    sched_repeat(id, (uint64_t)interval * uart0_char_cycles());
+    uart0_intrpt();
+}
+
+static void uart0_tx_load(void) {
+    uart0.txShift = uart_fifo_pop(&uart0.tx);
+    uart0.txBusy = true;
+    if (!uart0.tx.count) {
+        uart0.txEmptyIntrpt = true;
+    }
+}
+
+static void uart0_tx_event(enum sched_item_id id) {
+    if (uart0.mcr & UART_MCR_LOOP) {
+        uart0_rx_push(uart0.txShift);
+    } else {
+        vdp_write_serial(uart0.txShift);
+    }
+    uart0.txBusy = false;
+    if (uart0.tx.count) {
+        uart0_tx_load();
+        sched_repeat(id, uart0_char_cycles());
+    }
+    uart0_intrpt();
+}
+
+static uint8_t uart0_read(const uint16_t pio, bool peek) {
+    uint8_t value = 0;
+
+    switch (pio & 7) {
+        case 0:
+            if (uart0.lcr & UART_LCR_DLAB) {
+                value = uart0.brg & 0xFF;
+            } else if (peek) {
+                value = uart0.rx.data[uart0.rx.head];
+            } else {
+                value = uart_fifo_pop(&uart0.rx);
+                uart0.rxTimeout = false;
+                uart0.rxIdle = 0;
+            }
+            break;
+        case 1:
+            value = uart0.lcr & UART_LCR_DLAB ? uart0.brg >> 8 : uart0.ier;
+            break;
+        case 2:
+            value = uart0_iir();
+            if (!peek && (value & 0x0F) == UART_IIR_TBE) {
+                uart0.txEmptyIntrpt = false;
+            }
+            break;
+        case 3:
+            value = uart0.lcr;
+            break;
+        case 4:
+            value = uart0.mcr;
+            break;
+        case 5:
+            value = (uart0.rx.count ? UART_LSR_DR : 0) |
+                    (!uart0.tx.count ? UART_LSR_THRE : 0) |
+                    (!uart0.tx.count && !uart0.txBusy ? UART_LSR_TEMT : 0);
+            break;
+        case 6:
+            break; /* no modem lines, CTS is wired to a GPIO */
+        case 7:
+            value = uart0.spr;
+            break;
+    }
+
+    if (!peek) {
+        uart0_intrpt();
+    }
+    return value;
+}
+
+static void uart0_write(const uint16_t pio, const uint8_t value, bool poke) {
+    (void)poke;
+
+    switch (pio & 7) {
+        case 0:
+            if (uart0.lcr & UART_LCR_DLAB) {
+                uart0.brg = (uart0.brg & 0xFF00) | value;
+                uart0_rx_start();
+            } else {
+                uart_fifo_push(&uart0.tx, uart0_fifo_size(), value);
+                uart0.txEmptyIntrpt = false;
+                if (!uart0.txBusy) {
+                    uart0_tx_load();
+                    sched_set(SCHED_UART0_TX, uart0_char_cycles());
+                }
+            }
+            break;
+        case 1:
+            if (uart0.lcr & UART_LCR_DLAB) {
+                uart0.brg = (uart0.brg & 0x00FF) | value << 8;
+                uart0_rx_start();
+            } else {
+                if ((value & ~uart0.ier & UART_IER_TIE) && !uart0.tx.count) {
+                    uart0.txEmptyIntrpt = true;
+                }
+                uart0.ier = value & UART_IER_MASK;
+            }
+            break;
+        case 2:
+            if ((value ^ uart0.fctl) & UART_FCTL_FIFOEN) {
+                uart_fifo_clear(&uart0.rx);
+                uart_fifo_clear(&uart0.tx);
+            }
+            if (value & UART_FCTL_CLRRXF) {
+                uart_fifo_clear(&uart0.rx);
+                uart0.rxTimeout = false;
+            }
+            if (value & UART_FCTL_CLRTXF) {
+                uart_fifo_clear(&uart0.tx);
+            }
+            uart0.fctl = value & (UART_FCTL_FIFOEN | UART_FCTL_TRIG);
+            break;
+        case 3:
+            uart0.lcr = value;
+            break;
+        case 4:
+            uart0.mcr = value & UART_MCR_MASK;
+            break;
+        case 7:
+            uart0.spr = value;
+            break;
+        default:
+            break;
+    }
+
+    uart0_intrpt();
+}
+
+void uart0_reset(void) {
+    memset(&uart0, 0, sizeof(uart0));
+    uart0.brg = 2;
+
+    sched.items[SCHED_UART0_RX].callback.event = uart0_rx_event;
+    sched.items[SCHED_UART0_RX].clock = CLOCK_CPU;
+    sched_clear(SCHED_UART0_RX);
+    sched.items[SCHED_UART0_TX].callback.event = uart0_tx_event;
+    sched.items[SCHED_UART0_TX].clock = CLOCK_CPU;
+    sched_clear(SCHED_UART0_TX);
+    intrpt_set(INT_UART0, false);
+
+    printf("[eZ80-Emu] UART0 reset.\n");
+}
+
+static const eZ80portrange_t device = {
+    .read  = uart0_read,
+    .write = uart0_write
+};
+
+eZ80portrange_t init_uart0(void) {
+    printf("[eZ80-Emu] Initialized UART0...\n");
+    return device;
+}
+
+bool uart0_save(FILE *image) {
+    return fwrite(&uart0, sizeof(uart0), 1, image) == 1;
+}
+
+bool uart0_restore(FILE *image) {
+    return fread(&uart0, sizeof(uart0), 1, image) == 1;
+}
@@ -0,0 +1,45 @@
+#ifndef UART_H
+#define UART_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "port.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define UART_FIFO_SIZE 16
+
+typedef struct uart_fifo {
+    uint8_t data[UART_FIFO_SIZE];
+    uint8_t head;
+    uint8_t count;
+} uart_fifo_t;
+
+/* eZ80F92 UART0, the serial link to the VDP */
+typedef struct uart_state {
+    uart_fifo_t rx, tx;
+    uint16_t brg;                   /* baud rate divisor, the bit clock is the cpu clock / (16 * brg) */
+    uint8_t ier, fctl, lcr, mcr, spr;
+    uint8_t txShift;                /* byte on the wire */
+    bool txBusy;
+    bool txEmptyIntrpt;             /* transmit buffer empty, until IIR reports it or THR is written */
+    bool rxTimeout;                 /* character timeout, until RBR is read */
+    uint8_t rxIdle;                 /* character times since the last byte was received */
+    uint8_t rxInterval;             /* character times until the next receive event */
+} uart_state_t;
+
+extern uart_state_t uart0;
+
+eZ80portrange_t init_uart0(void);
+void uart0_reset(void);
+bool uart0_restore(FILE *image);
+bool uart0_save(FILE *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
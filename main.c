@@ -10,6 +10,7 @@
 #include "asic.h"
 #include "bus.h"
 #include "cpu.h"
+#include "emu.h"
 #include "mem.h"
 #include "schedule.h"
 
@@ -21,7 +22,6 @@
 
 // #define MAX_RESET_PROCS 20
 
-uint8_t *memory = NULL;
 struct zdis_ctx ctx;
 char disassemblyLine[256] = {0};
 int idx = 0;
@@ -49,7 +49,8 @@ int myputchar (int __c)
 
 static int read(struct zdis_ctx *ctx, uint32_t addr) 
 {
-    return ctx->zdis_user_ptr[addr];
+    (void)ctx;
+    return mem_peek_byte(addr);
 }
 
 static bool put(struct zdis_ctx *ctx, enum zdis_put kind, int32_t val, bool il) {
@@ -156,6 +157,14 @@ void eZ80_init(void)
 {
     asic_free();
     asic_init();
+
+		// JH - Hardcode loading of MOS image, before the reset so the cpu prefetches from it
+    printf("Loading MOS hex image...\n");
+		if (!loadHex("MOS_debug.hex"))
+			{
+			exit(EXIT_FAILURE);
+			}
+
     asic_reset();
 
     sched_set_clock(CLOCK_RUN, 1000);
@@ -184,7 +193,7 @@ void printBytes(struct zdis_ctx *ctx)
 
     while (startAddress < ctx->zdis_end_addr) 
     {
-        printf("%02X ", memory[startAddress]);
+        printf("%02X ", mem_peek_byte(startAddress));
         startAddress++;
         padding--;
     } /* end while */
@@ -208,7 +217,8 @@ void printRegisters(eZ80registers_t registers)
 }
 
 
-void emu_run(uint64_t ticks) {
+/* emu_run with a disassembly of every instruction */
+static void emu_run_traced(uint64_t ticks) {
     sched.run_event_triggered = false;
     sched_repeat(SCHED_RUN, ticks);
     while (cpu.abort != CPU_ABORT_EXIT) 
@@ -245,6 +255,9 @@ void emu_run(uint64_t ticks) {
 
 				// Allow vdp to process input and do it's thing
 				vdp_tick();
+
+				// Sleep off any lead over real time (off here, at 1 Hz every instruction would take a second)
+				emu_throttle();
     } /* end while */
 }
 
@@ -264,14 +277,6 @@ int main(int argc, char **argv)
 
     printf("Agon Light eZ80 emulator v0.0.1\n");
 
-		// JH - Hardcode loading of MOS image
-    printf("Loading MOS hex image...\n");
-		memory = loadHex("MOS_debug.hex");
-		if (!memory)
-			{
-			exit(EXIT_FAILURE);
-			}
-
 /* other faff
 		c = 0;
     while (c > -1) 
@@ -289,8 +294,7 @@ int main(int argc, char **argv)
 					break;
 				case 'H':
 					fprintf(stdout, "Hex: %s\n", optarg);
-					memory = loadHex(optarg);
-					if (memory == NULL)
+					if (!loadHex(optarg))
 						{
 						exit(EXIT_FAILURE);
 						}
@@ -315,10 +319,19 @@ int main(int argc, char **argv)
     ctx.zdis_lowercase = true; // automatically convert ZDIS_PUT_CHAR characters to lowercase
     ctx.zdis_implicit = true; // omit certain destination arguments as per z80 style assembly
     ctx.zdis_adl = false; // default word width when not overridden by suffix
-    ctx.zdis_user_ptr = memory; // arbitrary use
     ctx.zdis_user_size = 0; // arbitrary use
 
-    emu_run(1);
+    emu_run_traced(1);
+
+#ifdef CPU_STATS
+    {
+        FILE *stats = fopen("cpu_stats.csv", "w");
+        if (stats) {
+            cpu_stats_save(stats);
+            fclose(stats);
+        }
+    }
+#endif
 
 		vdp_shutdown();
 
@@ -0,0 +1,250 @@
+/*
+ * Offline reader for the access traces written by the core's tracer (emu-library/trace.c)
+ *
+ * Prints totals per access kind, the hottest 4 KB pages and ports, and the working set: how many
+ * distinct 256 byte lines of memory were touched per window of cycles. With -H the whole memory
+ * heatmap is written as csv, one row per touched 256 byte line. With -d every record is decoded to
+ * stdout instead, which turns an I/O trace (bench -P) into a readable log of the guest's port traffic.
+ *
+ * Usage: tracestat [-w cycles] [-n top] [-H heatmap.csv] [-d] trace.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace.h"
+
+#define LINE_SHIFT 8
+#define LINE_COUNT (1 << (24 - LINE_SHIFT))
+#define PAGE_SHIFT 12
+#define PAGE_COUNT (1 << (24 - PAGE_SHIFT))
+#define PORT_COUNT 0x10000
+
+#define DEFAULT_WINDOW 1000000u
+#define DEFAULT_TOP    16u
+
+typedef struct {
+    uint64_t count[TRACE_KINDS];
+} counts_t;
+
+static const char *kind_names[TRACE_KINDS] = { "mem read", "mem write", "fetch", "port read", "port write" };
+
+static counts_t lines[LINE_COUNT];
+static counts_t pages[PAGE_COUNT];
+static counts_t ports[PORT_COUNT];
+static uint32_t line_window[LINE_COUNT];    /* last window a line was touched in, plus one */
+static bool line_seen[LINE_COUNT];
+
+static bool read_varint(FILE *file, uint64_t *value) {
+    int shift = 0, c;
+    *value = 0;
+    do {
+        if ((c = fgetc(file)) == EOF || shift > 63) {
+            return false;
+        }
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return true;
+}
+
+static uint64_t total(const counts_t *counts, int first, int last) {
+    uint64_t sum = 0;
+    int kind;
+    for (kind = first; kind <= last; kind++) {
+        sum += counts->count[kind];
+    }
+    return sum;
+}
+
+static uint64_t mem_total(const counts_t *counts) {
+    return total(counts, TRACE_MEM_READ, TRACE_MEM_FETCH);
+}
+
+static uint64_t port_total(const counts_t *counts) {
+    return total(counts, TRACE_PORT_READ, TRACE_PORT_WRITE);
+}
+
+/* Indices of the top n entries by weight, simple selection since n is small */
+static uint32_t top_entries(const counts_t *table, uint32_t size, uint64_t (*weight)(const counts_t *),
+                            uint32_t *top, uint32_t n) {
+    uint32_t found = 0, i, j;
+    for (i = 0; i < size; i++) {
+        uint64_t w = weight(&table[i]);
+        if (!w || (found == n && w <= weight(&table[top[n - 1]]))) {
+            continue;
+        }
+        j = found < n ? found++ : n - 1;
+        for (; j > 0 && weight(&table[top[j - 1]]) < w; j--) {
+            top[j] = top[j - 1];
+        }
+        top[j] = i;
+    }
+    return found;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-w cycles] [-n top] [-H heatmap.csv] [-d] trace.bin\n", name);
+    fprintf(stderr, "  -w cycles       working set window (default %u)\n", DEFAULT_WINDOW);
+    fprintf(stderr, "  -n top          pages and ports to list (default %u)\n", DEFAULT_TOP);
+    fprintf(stderr, "  -H heatmap.csv  write reads, writes and fetches per 256 byte line\n");
+    fprintf(stderr, "  -d              print every record: cycle, kind, address and value\n");
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL, *heatmap = NULL;
+    uint64_t window = DEFAULT_WINDOW, clock, start, cycle, delta, zigzag, records = 0;
+    uint64_t kinds[TRACE_KINDS] = { 0 };
+    uint32_t last_address[TRACE_KINDS] = { 0 };
+    uint32_t top_count = DEFAULT_TOP, *top, found, windows = 0, window_index = 0;
+    uint32_t ws = 0, ws_min = UINT32_MAX, ws_max = 0, distinct = 0;
+    uint64_t ws_sum = 0;
+    bool dump = false;
+    char magic[8];
+    FILE *file;
+    int c, value, i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            window = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            top_count = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-H") && i + 1 < argc) {
+            heatmap = argv[++i];
+        } else if (!strcmp(argv[i], "-d")) {
+            dump = true;
+        } else if (argv[i][0] == '-' || path) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || !window || !top_count) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!(file = fopen(path, "rb"))) {
+        fprintf(stderr, "tracestat: couldn't open %s\n", path);
+        return EXIT_FAILURE;
+    }
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, TRACE_MAGIC, 7) || magic[7] != TRACE_VERSION ||
+        !read_varint(file, &clock) || !read_varint(file, &start)) {
+        fprintf(stderr, "tracestat: %s is not a version %d trace\n", path, TRACE_VERSION);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    cycle = start;
+    while ((c = fgetc(file)) != EOF) {
+        uint32_t address;
+        if (c >= TRACE_KINDS || !read_varint(file, &delta) || !read_varint(file, &zigzag) ||
+            (value = fgetc(file)) == EOF) {
+            fprintf(stderr, "tracestat: truncated or corrupt record %llu\n", (unsigned long long)records);
+            break;
+        }
+        cycle += delta;
+        address = last_address[c] + (uint32_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        last_address[c] = address;
+        kinds[c]++;
+        records++;
+
+        if (dump) {
+            printf("%12llu %-10s %0*X %02X\n", (unsigned long long)(cycle - start), kind_names[c],
+                   c >= TRACE_PORT_READ ? 4 : 6, c >= TRACE_PORT_READ ? address & 0xFFFF : address & 0xFFFFFF, value);
+            continue;
+        }
+
+        if (c >= TRACE_PORT_READ) {
+            ports[address & 0xFFFF].count[c]++;
+            continue;
+        }
+        address &= 0xFFFFFF;
+        lines[address >> LINE_SHIFT].count[c]++;
+        pages[address >> PAGE_SHIFT].count[c]++;
+
+        while ((cycle - start) / window > window_index) {
+            if (ws) {
+                windows++;
+                ws_sum += ws;
+                ws_min = ws < ws_min ? ws : ws_min;
+                ws_max = ws > ws_max ? ws : ws_max;
+            }
+            ws = 0;
+            window_index = (uint32_t)((cycle - start) / window);
+        }
+        if (line_window[address >> LINE_SHIFT] != window_index + 1) {
+            line_window[address >> LINE_SHIFT] = window_index + 1;
+            ws++;
+        }
+        if (!line_seen[address >> LINE_SHIFT]) {
+            line_seen[address >> LINE_SHIFT] = true;
+            distinct++;
+        }
+    }
+    fclose(file);
+    if (dump) {
+        return EXIT_SUCCESS;
+    }
+    if (ws) {
+        windows++;
+        ws_sum += ws;
+        ws_min = ws < ws_min ? ws : ws_min;
+        ws_max = ws > ws_max ? ws : ws_max;
+    }
+
+    printf("%s: %llu records over %llu cycles (%.3f s at %.3f MHz)\n", path, (unsigned long long)records,
+           (unsigned long long)(cycle - start), clock ? (double)(cycle - start) / clock : 0.0, clock / 1e6);
+    for (i = 0; i < TRACE_KINDS; i++) {
+        printf("  %-11s %llu\n", kind_names[i], (unsigned long long)kinds[i]);
+    }
+
+    if (!(top = malloc(top_count * sizeof *top))) {
+        return EXIT_FAILURE;
+    }
+    found = top_entries(pages, PAGE_COUNT, mem_total, top, top_count);
+    printf("\nhottest pages          reads     writes    fetches\n");
+    for (i = 0; i < (int)found; i++) {
+        const counts_t *p = &pages[top[i]];
+        printf("  %06X-%06X %10llu %10llu %10llu\n", top[i] << PAGE_SHIFT, ((top[i] + 1) << PAGE_SHIFT) - 1,
+               (unsigned long long)p->count[TRACE_MEM_READ], (unsigned long long)p->count[TRACE_MEM_WRITE],
+               (unsigned long long)p->count[TRACE_MEM_FETCH]);
+    }
+    found = top_entries(ports, PORT_COUNT, port_total, top, top_count);
+    printf("\nhottest ports    reads     writes\n");
+    for (i = 0; i < (int)found; i++) {
+        const counts_t *p = &ports[top[i]];
+        printf("  %04X    %10llu %10llu\n", top[i], (unsigned long long)p->count[TRACE_PORT_READ],
+               (unsigned long long)p->count[TRACE_PORT_WRITE]);
+    }
+    free(top);
+
+    printf("\nworking set (%d byte lines per %llu cycles)\n", 1 << LINE_SHIFT, (unsigned long long)window);
+    if (windows) {
+        printf("  min %u, avg %.1f, max %u lines over %u windows\n", ws_min, (double)ws_sum / windows, ws_max, windows);
+    }
+    printf("  %u lines (%u KiB) touched in total\n", distinct, (distinct << LINE_SHIFT) / 1024);
+
+    if (heatmap) {
+        FILE *csv = fopen(heatmap, "w");
+        uint32_t line;
+        if (!csv) {
+            fprintf(stderr, "tracestat: couldn't write %s\n", heatmap);
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "address,reads,writes,fetches\n");
+        for (line = 0; line < LINE_COUNT; line++) {
+            const counts_t *l = &lines[line];
+            if (mem_total(l)) {
+                fprintf(csv, "%06X,%llu,%llu,%llu\n", line << LINE_SHIFT, (unsigned long long)l->count[TRACE_MEM_READ],
+                        (unsigned long long)l->count[TRACE_MEM_WRITE], (unsigned long long)l->count[TRACE_MEM_FETCH]);
+            }
+        }
+        fclose(csv);
+    }
+    return EXIT_SUCCESS;
+}
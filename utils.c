@@ -8,19 +8,18 @@
 
 #include "kk_ihex_read.h"
 #include "kk_ihex.h"
+#include "mem.h"
 
 
-#define MEMORY_SIZE                         (16 * 1024 * 1024)
 #define AUTODETECT_ADDRESS                  (~0UL)
 
 
 static unsigned long    line_number         = 1L;
 static unsigned long    address_offset      = 0UL;
 static bool             debug_enabled       = false;
-static uint8_t          *memory             = NULL;
 
 // JH - For Windows 32/64
-int getline(char *buffer, size_t bufferSize, FILE *fp)
+static int read_line(char *buffer, size_t bufferSize, FILE *fp)
 {
 	char *result = NULL;
 	buffer[0] = 0;
@@ -29,54 +28,42 @@ int getline(char *buffer, size_t bufferSize, FILE *fp)
 }
 
 
-uint8_t *loadHex(char *filePath)
+/* Writes the image straight into guest memory, so the emulator must be initialized first */
+bool loadHex(const char *filePath)
 {
     FILE *infile = NULL;
 
-    if (memory != NULL) 
+    infile = fopen(filePath, "rb");
+    if (infile == NULL)
     {
-        free(memory);
-    } /* end if */
-    
-    memory = calloc(MEMORY_SIZE, sizeof(uint8_t));
-    if (memory == NULL)
-    {
-        return NULL;
+        return false;
     }
     else
     {
-        infile = fopen(filePath, "rb");
-        if (infile == NULL)
-        {
-            return NULL;
-        }
-        else
-        {
-            char								line[1024];
-            size_t              len     = 1024;
-            int                 read    = -1;
-            struct  ihex_state  ihex;
+        char								line[1024];
+        size_t              len     = 1024;
+        int                 read    = -1;
+        struct  ihex_state  ihex;
 
-            ihex_begin_read(&ihex);        
+        ihex_begin_read(&ihex);        
 
-            while ((read = getline(line, len, infile)) != -1)
+        while ((read = read_line(line, len, infile)) != -1)
+        {
+            if (debug_enabled) 
             {
-                if (debug_enabled) 
-                {
-                    printf("Retrieved line of length %d :\n", read);
-                    printf("%s", line);
-                } /* end if */
+                printf("Retrieved line of length %d :\n", read);
+                printf("%s", line);
+            } /* end if */
 
-                ihex_read_bytes(&ihex, line, read);
-            } /* end while */
+            ihex_read_bytes(&ihex, line, read);
+        } /* end while */
 
-            //free(line);
+        //free(line);
 
-            ihex_end_read(&ihex);
-            fclose(infile);
-        } /* end if */
+        ihex_end_read(&ihex);
+        fclose(infile);
     } /* end if */
-    return memory;
+    return true;
 } /* end loadHex */
 
 
@@ -120,7 +107,7 @@ ihex_bool_t ihex_data_read(struct ihex_state   *ihex,
         } /* end if */
         for (size_t idx = 0; idx < ihex->length; idx++)
         {
-            memory[address + idx] = ihex->data[idx];
+            mem_poke_byte((uint32_t)(address + idx), ihex->data[idx]);
         } /* end for */
     } 
     else if (type == IHEX_END_OF_FILE_RECORD) 
@@ -2,7 +2,8 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-uint8_t *loadHex(char *filePath);
+bool loadHex(const char *filePath);
 
 #endif /* UTILS_H */
\ No newline at end of file